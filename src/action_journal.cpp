@@ -0,0 +1,242 @@
+#include <cstddef>
+#include <cstdint>
+
+#include <deque>
+#include <map>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "action_journal.h"
+#include "hero.h"
+#include "tower.h"
+
+namespace MagicTower
+{
+    //every field except position and direction
+    static bool same_hero_stats( const Hero& lhs , const Hero& rhs )
+    {
+        return lhs.floors == rhs.floors && lhs.level == rhs.level && lhs.life == rhs.life &&
+            lhs.attack == rhs.attack && lhs.defense == rhs.defense && lhs.gold == rhs.gold &&
+            lhs.experience == rhs.experience && lhs.yellow_key == rhs.yellow_key &&
+            lhs.blue_key == rhs.blue_key && lhs.red_key == rhs.red_key;
+    }
+
+    static bool same_hero( const Hero& lhs , const Hero& rhs )
+    {
+        return same_hero_stats( lhs , rhs ) && lhs.x == rhs.x && lhs.y == rhs.y && lhs.direction == rhs.direction;
+    }
+
+    //one pass over both sorted maps,change is { key , before , after }
+    template<typename Key , typename Change>
+    static void diff_map( const std::map<Key , std::uint32_t>& before , const std::map<Key , std::uint32_t>& after ,
+        std::vector<Change>& changes )
+    {
+        auto before_iter = before.begin();
+        auto after_iter = after.begin();
+        while ( before_iter != before.end() || after_iter != after.end() )
+        {
+            if ( after_iter == after.end() || ( before_iter != before.end() && before_iter->first < after_iter->first ) )
+            {
+                changes.push_back( { before_iter->first , before_iter->second , std::nullopt } );
+                before_iter++;
+            }
+            else if ( before_iter == before.end() || after_iter->first < before_iter->first )
+            {
+                changes.push_back( { after_iter->first , std::nullopt , after_iter->second } );
+                after_iter++;
+            }
+            else
+            {
+                if ( before_iter->second != after_iter->second )
+                    changes.push_back( { before_iter->first , before_iter->second , after_iter->second } );
+                before_iter++;
+                after_iter++;
+            }
+        }
+    }
+
+    template<typename Key>
+    static void set_value( std::map<Key , std::uint32_t>& values , const Key& key , const std::optional<std::uint32_t>& value )
+    {
+        if ( value.has_value() )
+            values[ key ] = value.value();
+        else
+            values.erase( key );
+    }
+
+    ActionJournal::ActionJournal( std::size_t _depth , std::size_t _change_budget ):
+        depth( _depth ),
+        change_budget( _change_budget ),
+        change_count( 0 ),
+        undo_records(),
+        redo_records(),
+        recording( false ),
+        grids(),
+        hero(),
+        flags(),
+        inventories()
+    {
+    }
+
+    void ActionJournal::set_depth( std::size_t _depth )
+    {
+        this->depth = _depth;
+        this->trim();
+    }
+
+    void ActionJournal::begin( TowerMap& tower , const Hero& _hero , const std::map<std::string , std::uint32_t>& _flags ,
+        const std::map<std::uint32_t , std::uint32_t>& _inventories )
+    {
+        this->recording = true;
+        this->restart( tower , _hero , _flags , _inventories );
+    }
+
+    bool ActionJournal::commit( TowerMap& tower , const Hero& _hero , const std::map<std::string , std::uint32_t>& _flags ,
+        const std::map<std::uint32_t , std::uint32_t>& _inventories )
+    {
+        if ( !this->recording )
+            return false;
+        this->recording = false;
+        tower.grid_journal = nullptr;
+
+        ActionRecord record = { std::move( this->grids ) , this->hero , _hero , {} , {} , false };
+        this->grids.clear();
+        diff_map( this->flags , _flags , record.flags );
+        diff_map( this->inventories , _inventories , record.inventories );
+        if ( record.grids.empty() && record.flags.empty() && record.inventories.empty() )
+        {
+            if ( same_hero( record.hero_before , record.hero_after ) )
+                return false;
+            record.walk = same_hero_stats( record.hero_before , record.hero_after );
+        }
+        this->redo_records.clear();
+
+        if ( record.walk && !this->undo_records.empty() && this->undo_records.back().walk &&
+            this->undo_records.back().hero_after.floors == record.hero_after.floors )
+        {
+            ActionRecord& last = this->undo_records.back();
+            last.hero_after = record.hero_after;
+            //walked back to where the steps began
+            if ( same_hero( last.hero_before , last.hero_after ) )
+            {
+                this->change_count -= record_cost( last );
+                this->undo_records.pop_back();
+            }
+            return true;
+        }
+        this->change_count += record_cost( record );
+        this->undo_records.push_back( std::move( record ) );
+        this->trim();
+        return true;
+    }
+
+    void ActionJournal::cancel( TowerMap& tower )
+    {
+        this->recording = false;
+        this->grids.clear();
+        tower.grid_journal = nullptr;
+    }
+
+    bool ActionJournal::undo( TowerMap& tower , Hero& _hero , std::map<std::string , std::uint32_t>& _flags ,
+        std::map<std::uint32_t , std::uint32_t>& _inventories )
+    {
+        if ( this->undo_records.empty() )
+            return false;
+        ActionRecord record = std::move( this->undo_records.back() );
+        this->undo_records.pop_back();
+        this->change_count -= record_cost( record );
+        apply( record , false , tower , _hero , _flags , _inventories );
+        this->redo_records.push_back( std::move( record ) );
+        if ( this->recording )
+            this->restart( tower , _hero , _flags , _inventories );
+        return true;
+    }
+
+    bool ActionJournal::redo( TowerMap& tower , Hero& _hero , std::map<std::string , std::uint32_t>& _flags ,
+        std::map<std::uint32_t , std::uint32_t>& _inventories )
+    {
+        if ( this->redo_records.empty() )
+            return false;
+        ActionRecord record = std::move( this->redo_records.back() );
+        this->redo_records.pop_back();
+        apply( record , true , tower , _hero , _flags , _inventories );
+        this->change_count += record_cost( record );
+        this->undo_records.push_back( std::move( record ) );
+        if ( this->recording )
+            this->restart( tower , _hero , _flags , _inventories );
+        return true;
+    }
+
+    void ActionJournal::clear( TowerMap& tower )
+    {
+        this->undo_records.clear();
+        this->redo_records.clear();
+        this->change_count = 0;
+        this->recording = false;
+        this->grids.clear();
+        tower.grid_journal = nullptr;
+    }
+
+    std::size_t ActionJournal::undo_size( void ) const
+    {
+        return this->undo_records.size();
+    }
+
+    std::size_t ActionJournal::redo_size( void ) const
+    {
+        return this->redo_records.size();
+    }
+
+    void ActionJournal::apply( const ActionRecord& record , bool forward , TowerMap& tower , Hero& _hero ,
+        std::map<std::string , std::uint32_t>& _flags , std::map<std::uint32_t , std::uint32_t>& _inventories )
+    {
+        //not recorded as a new change
+        std::vector<GridChange> * grid_journal = tower.grid_journal;
+        tower.grid_journal = nullptr;
+        if ( forward )
+        {
+            for ( const GridChange& change : record.grids )
+                tower.set_grid( change.floor_id , change.x , change.y , change.after );
+        }
+        else
+        {
+            //the same grid may be set more than once in one action
+            for ( auto iter = record.grids.rbegin() ; iter != record.grids.rend() ; iter++ )
+                tower.set_grid( iter->floor_id , iter->x , iter->y , iter->before );
+        }
+        tower.grid_journal = grid_journal;
+
+        _hero = forward ? record.hero_after : record.hero_before;
+        for ( const FlagChange& change : record.flags )
+            set_value( _flags , change.flag_name , forward ? change.after : change.before );
+        for ( const InventoryChange& change : record.inventories )
+            set_value( _inventories , change.item_id , forward ? change.after : change.before );
+    }
+
+    std::size_t ActionJournal::record_cost( const ActionRecord& record )
+    {
+        return 1 + record.grids.size() + record.flags.size() + record.inventories.size();
+    }
+
+    void ActionJournal::trim( void )
+    {
+        while ( !this->undo_records.empty() &&
+            ( this->undo_records.size() > this->depth || this->change_count > this->change_budget ) )
+        {
+            this->change_count -= record_cost( this->undo_records.front() );
+            this->undo_records.pop_front();
+        }
+    }
+
+    void ActionJournal::restart( TowerMap& tower , const Hero& _hero , const std::map<std::string , std::uint32_t>& _flags ,
+        const std::map<std::uint32_t , std::uint32_t>& _inventories )
+    {
+        this->grids.clear();
+        this->hero = _hero;
+        this->flags = _flags;
+        this->inventories = _inventories;
+        tower.grid_journal = &( this->grids );
+    }
+}
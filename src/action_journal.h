@@ -0,0 +1,104 @@
+#pragma once
+#ifndef ACTION_JOURNAL_H
+#define ACTION_JOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <deque>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "hero.h"
+#include "tower.h"
+
+namespace MagicTower
+{
+    //undo/redo history of player actions,main thread only.
+    //grids are recorded by TowerMap::set_grid during the action,hero,script flags and inventories are
+    //compared with the copy taken at begin,so a record hold only what the action changed.
+    //consecutive walking steps on one floor are merged into one record,
+    //history is bounded by record count and by total change count
+    class ActionJournal
+    {
+    public:
+        ActionJournal( std::size_t depth = 64 , std::size_t change_budget = 65536 );
+
+        void set_depth( std::size_t depth );
+        //start recording one action
+        void begin( TowerMap& tower , const Hero& hero , const std::map<std::string , std::uint32_t>& flags ,
+            const std::map<std::uint32_t , std::uint32_t>& inventories );
+        //stop recording,keep a record if anything changed,redo history is dropped then.
+        //true if anything changed
+        bool commit( TowerMap& tower , const Hero& hero , const std::map<std::string , std::uint32_t>& flags ,
+            const std::map<std::uint32_t , std::uint32_t>& inventories );
+        //stop recording without a record
+        void cancel( TowerMap& tower );
+        //false if no history,the current recording restart from the restored state
+        bool undo( TowerMap& tower , Hero& hero , std::map<std::string , std::uint32_t>& flags ,
+            std::map<std::uint32_t , std::uint32_t>& inventories );
+        bool redo( TowerMap& tower , Hero& hero , std::map<std::string , std::uint32_t>& flags ,
+            std::map<std::uint32_t , std::uint32_t>& inventories );
+        //after load or new game,the recording is cancelled too
+        void clear( TowerMap& tower );
+        std::size_t undo_size( void ) const;
+        std::size_t redo_size( void ) const;
+
+        ActionJournal( const ActionJournal& rhs )=delete;
+        ActionJournal( ActionJournal&& rhs )=delete;
+        ActionJournal& operator=( const ActionJournal& rhs )=delete;
+        ActionJournal& operator=( ActionJournal&& rhs )=delete;
+    private:
+        //nullopt:key absent
+        struct FlagChange
+        {
+            std::string flag_name;
+            std::optional<std::uint32_t> before;
+            std::optional<std::uint32_t> after;
+        };
+
+        struct InventoryChange
+        {
+            std::uint32_t item_id;
+            std::optional<std::uint32_t> before;
+            std::optional<std::uint32_t> after;
+        };
+
+        struct ActionRecord
+        {
+            std::vector<GridChange> grids;
+            Hero hero_before;
+            Hero hero_after;
+            std::vector<FlagChange> flags;
+            std::vector<InventoryChange> inventories;
+            //only hero position and direction changed
+            bool walk;
+        };
+
+        //apply before value( undo ) or after value( redo )
+        static void apply( const ActionRecord& record , bool forward , TowerMap& tower , Hero& hero ,
+            std::map<std::string , std::uint32_t>& flags , std::map<std::uint32_t , std::uint32_t>& inventories );
+        static std::size_t record_cost( const ActionRecord& record );
+        //drop the oldest record until in bound
+        void trim( void );
+        void restart( TowerMap& tower , const Hero& hero , const std::map<std::string , std::uint32_t>& flags ,
+            const std::map<std::uint32_t , std::uint32_t>& inventories );
+
+        std::size_t depth;
+        std::size_t change_budget;
+        std::size_t change_count;
+        std::deque<ActionRecord> undo_records;
+        std::vector<ActionRecord> redo_records;
+
+        //current action
+        bool recording;
+        std::vector<GridChange> grids;
+        Hero hero;
+        std::map<std::string , std::uint32_t> flags;
+        std::map<std::uint32_t , std::uint32_t> inventories;
+    };
+}
+
+#endif
@@ -0,0 +1,82 @@
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+#include <glibmm.h>
+
+#include "autosave.h"
+
+namespace MagicTower
+{
+    //stair hopping within this time is one save
+    static const unsigned int coalesce_delay = 1500;
+    //saver refused,e.g. dialog open or a save still writing
+    static const unsigned int retry_delay = 1000;
+
+    AutosaveScheduler::AutosaveScheduler( std::size_t _action_interval , unsigned int _min_interval ):
+        saver(),
+        action_interval( _action_interval ),
+        action_count( 0 ),
+        min_interval( _min_interval ),
+        last_save( 0 ),
+        timer()
+    {
+    }
+
+    AutosaveScheduler::~AutosaveScheduler()
+    {
+        this->timer.disconnect();
+    }
+
+    void AutosaveScheduler::set_saver( Saver _saver )
+    {
+        this->saver = std::move( _saver );
+    }
+
+    void AutosaveScheduler::request( void )
+    {
+        //already scheduled,merged
+        if ( this->timer.connected() )
+            return ;
+        unsigned int delay = coalesce_delay;
+        if ( this->last_save != 0 )
+        {
+            std::int64_t elapsed = ( g_get_monotonic_time() - this->last_save )/1000;
+            if ( elapsed < this->min_interval )
+                delay = std::max<unsigned int>( delay , this->min_interval - elapsed );
+        }
+        this->schedule( delay );
+    }
+
+    void AutosaveScheduler::note_action( void )
+    {
+        if ( this->action_interval == 0 )
+            return ;
+        this->action_count++;
+        if ( this->action_count >= this->action_interval )
+            this->request();
+    }
+
+    void AutosaveScheduler::schedule( unsigned int delay )
+    {
+        this->timer.disconnect();
+        this->timer = Glib::signal_timeout().connect( sigc::mem_fun( *this , &AutosaveScheduler::on_timeout ) , delay );
+    }
+
+    bool AutosaveScheduler::on_timeout( void )
+    {
+        if ( !this->saver )
+            return false;
+        if ( !this->saver() )
+        {
+            this->schedule( retry_delay );
+            return false;
+        }
+        this->last_save = g_get_monotonic_time();
+        this->action_count = 0;
+        return false;
+    }
+}
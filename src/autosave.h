@@ -0,0 +1,51 @@
+#pragma once
+#ifndef AUTOSAVE_H
+#define AUTOSAVE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <functional>
+
+#include <glibmm.h>
+
+namespace MagicTower
+{
+    //decide when to autosave,main thread only.
+    //floor change and every action_interval actions request a save,requests made before the save run
+    //are merged into one,and saves are at least min_interval apart.the save itself is done by the saver
+    class AutosaveScheduler
+    {
+    public:
+        //saver return false if the game can't be saved now,it is retried later
+        typedef std::function<bool( void )> Saver;
+
+        AutosaveScheduler( std::size_t action_interval = 50 , unsigned int min_interval = 10000 );
+        ~AutosaveScheduler();
+
+        void set_saver( Saver saver );
+        void request( void );
+        //a recorded player action
+        void note_action( void );
+
+        AutosaveScheduler( const AutosaveScheduler& rhs )=delete;
+        AutosaveScheduler( AutosaveScheduler&& rhs )=delete;
+        AutosaveScheduler& operator=( const AutosaveScheduler& rhs )=delete;
+        AutosaveScheduler& operator=( AutosaveScheduler&& rhs )=delete;
+    private:
+        //millisecond
+        void schedule( unsigned int delay );
+        bool on_timeout( void );
+
+        Saver saver;
+        std::size_t action_interval;
+        std::size_t action_count;
+        //millisecond
+        unsigned int min_interval;
+        //g_get_monotonic_time of last save,0 if none
+        std::int64_t last_save;
+        sigc::connection timer;
+    };
+}
+
+#endif
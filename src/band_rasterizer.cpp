@@ -0,0 +1,149 @@
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <cairo.h>
+#include <cairomm/cairomm.h>
+
+#include "band_rasterizer.h"
+
+namespace MagicTower
+{
+    BandRasterizer::BandRasterizer():
+        job_mutex(),
+        job_condition(),
+        done_condition(),
+        bands( nullptr ),
+        painted(),
+        pixel_size( 0 ),
+        scale( 1 ),
+        next_band( 0 ),
+        remaining( 0 ),
+        stop( false ),
+        workers()
+    {
+        //main thread is one of the painter
+        unsigned int worker_count = std::clamp( std::thread::hardware_concurrency() , 2u , 5u ) - 1;
+        for ( unsigned int i = 0 ; i < worker_count ; i++ )
+        {
+            this->workers.emplace_back( &BandRasterizer::worker_loop , this );
+        }
+    }
+
+    BandRasterizer::~BandRasterizer()
+    {
+        {
+            std::lock_guard<std::mutex> lock( this->job_mutex );
+            this->stop = true;
+        }
+        this->job_condition.notify_all();
+        for ( auto& worker : this->workers )
+        {
+            worker.join();
+        }
+    }
+
+    BandRasterizer::TileBlit BandRasterizer::make_blit( const Cairo::RefPtr<Cairo::ImageSurface>& tile , std::uint32_t x , std::uint32_t y )
+    {
+        return { tile->get_data() , tile->get_width() , tile->get_height() , tile->get_stride() , x , y };
+    }
+
+    void BandRasterizer::rasterize( std::vector<Band>& _bands , std::uint32_t _pixel_size , std::uint32_t _scale )
+    {
+        if ( _bands.empty() )
+            return ;
+        std::unique_lock<std::mutex> lock( this->job_mutex );
+        this->bands = &_bands;
+        this->painted.assign( _bands.size() , nullptr );
+        this->pixel_size = _pixel_size;
+        this->scale = std::max<std::uint32_t>( _scale , 1 );
+        this->next_band = 0;
+        this->remaining = _bands.size();
+        this->job_condition.notify_all();
+
+        while ( this->paint_next_band( lock ) )
+        {
+        }
+        this->done_condition.wait( lock , [ this ](){ return this->remaining == 0; } );
+        this->bands = nullptr;
+
+        for ( std::size_t i = 0 ; i < _bands.size() ; i++ )
+        {
+            //take the reference from worker
+            _bands[i].surface = Cairo::RefPtr<Cairo::ImageSurface>( new Cairo::ImageSurface( this->painted[i] , true ) );
+        }
+        this->painted.clear();
+    }
+
+    void BandRasterizer::worker_loop( void )
+    {
+        std::unique_lock<std::mutex> lock( this->job_mutex );
+        while ( true )
+        {
+            this->job_condition.wait( lock , [ this ](){ return this->stop || ( this->bands != nullptr && this->next_band < this->bands->size() ); } );
+            if ( this->stop )
+                return ;
+            while ( this->paint_next_band( lock ) )
+            {
+            }
+        }
+    }
+
+    bool BandRasterizer::paint_next_band( std::unique_lock<std::mutex>& lock )
+    {
+        if ( this->bands == nullptr || this->next_band >= this->bands->size() )
+            return false;
+        std::size_t index = this->next_band++;
+        const Band& band = ( *this->bands )[ index ];
+        std::uint32_t band_pixel_size = this->pixel_size;
+        std::uint32_t band_scale = this->scale;
+
+        lock.unlock();
+        cairo_surface_t * surface = paint_band( band , band_pixel_size , band_scale );
+        lock.lock();
+
+        this->painted[ index ] = surface;
+        this->remaining--;
+        if ( this->remaining == 0 )
+            this->done_condition.notify_all();
+        return true;
+    }
+
+    cairo_surface_t * BandRasterizer::paint_band( const Band& band , std::uint32_t pixel_size , std::uint32_t scale )
+    {
+        cairo_surface_t * surface = cairo_image_surface_create( CAIRO_FORMAT_ARGB32 ,
+            band.length*pixel_size*scale , band.width*pixel_size*scale );
+        cairo_surface_set_device_scale( surface , scale , scale );
+        cairo_t * cairo_context = cairo_create( surface );
+        cairo_set_operator( cairo_context , CAIRO_OPERATOR_SOURCE );
+
+        //private surface over the shared tile pixel,one per distinct tile
+        std::map<const unsigned char *,cairo_surface_t *> tile_surfaces;
+        for ( const TileBlit& blit : band.blits )
+        {
+            cairo_surface_t *& tile_surface = tile_surfaces[ blit.data ];
+            if ( tile_surface == nullptr )
+            {
+                tile_surface = cairo_image_surface_create_for_data( const_cast<unsigned char *>( blit.data ) , CAIRO_FORMAT_ARGB32 ,
+                    blit.width , blit.height , blit.stride );
+                cairo_surface_set_device_scale( tile_surface , scale , scale );
+            }
+            cairo_set_source_surface( cairo_context , tile_surface , blit.x*pixel_size , blit.y*pixel_size );
+            cairo_rectangle( cairo_context , blit.x*pixel_size , blit.y*pixel_size , pixel_size , pixel_size );
+            cairo_fill( cairo_context );
+        }
+        cairo_destroy( cairo_context );
+        for ( auto& tile_surface : tile_surfaces )
+        {
+            cairo_surface_destroy( tile_surface.second );
+        }
+        cairo_surface_flush( surface );
+        return surface;
+    }
+}
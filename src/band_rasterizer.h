@@ -0,0 +1,79 @@
+#pragma once
+#ifndef BAND_RASTERIZER_H
+#define BAND_RASTERIZER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <cairomm/cairomm.h>
+
+namespace MagicTower
+{
+    //paint grid tiles of many bands in parallel,each band into its own image surface.
+    //worker only touch cairo image surface created by itself and read tile pixel,
+    //no GTK/GDK call and no cairomm reference count shared across thread
+    class BandRasterizer
+    {
+    public:
+        //tile pixel,ARGB32 premultiplied,must stay alive until rasterize return
+        struct TileBlit
+        {
+            const unsigned char * data;
+            int width;
+            int height;
+            int stride;
+            //grid position in band
+            std::uint32_t x;
+            std::uint32_t y;
+        };
+
+        //length*width grids,surface is filled by rasterize
+        struct Band
+        {
+            std::uint32_t length;
+            std::uint32_t width;
+            std::vector<TileBlit> blits;
+            Cairo::RefPtr<Cairo::ImageSurface> surface;
+        };
+
+        BandRasterizer();
+        ~BandRasterizer();
+
+        //tile surface must be flushed,main thread only
+        static TileBlit make_blit( const Cairo::RefPtr<Cairo::ImageSurface>& tile , std::uint32_t x , std::uint32_t y );
+        //block until every band painted,main thread paint bands too.
+        //pixel_size:logical grid size,band surface has pixel_size*scale pixel per grid and device scale
+        void rasterize( std::vector<Band>& bands , std::uint32_t pixel_size , std::uint32_t scale );
+
+        BandRasterizer( const BandRasterizer& rhs )=delete;
+        BandRasterizer( BandRasterizer&& rhs )=delete;
+        BandRasterizer& operator=( const BandRasterizer& rhs )=delete;
+        BandRasterizer& operator=( BandRasterizer&& rhs )=delete;
+    private:
+        void worker_loop( void );
+        //take next band of current batch,false if none left
+        bool paint_next_band( std::unique_lock<std::mutex>& lock );
+        static cairo_surface_t * paint_band( const Band& band , std::uint32_t pixel_size , std::uint32_t scale );
+
+        //current batch,guard by job_mutex
+        std::mutex job_mutex;
+        std::condition_variable job_condition;
+        std::condition_variable done_condition;
+        const std::vector<Band> * bands;
+        std::vector<cairo_surface_t *> painted;
+        std::uint32_t pixel_size;
+        std::uint32_t scale;
+        std::size_t next_band;
+        std::size_t remaining;
+        bool stop;
+
+        std::vector<std::thread> workers;
+    };
+}
+
+#endif
@@ -1,6 +1,8 @@
 #include <cstddef>
 #include <cinttypes>
 
+#include <functional>
+#include <memory>
 #include <optional>
 #include <stdexcept>
 #include <string>
@@ -11,31 +13,90 @@
 #include "hero.h"
 #include "item.h"
 #include "monster.h"
+#include "save_codec.h"
 #include "tower.h"
 
 namespace MagicTower
 {
-    DataBase::DataBase( std::string filename ):
+    //fewer free pages than this are not worth a VACUUM
+    static const std::int64_t vacuum_free_pages = 256;
+
+    SqlStatement::SqlStatement( sqlite3 * db_handler , const char * sql_statement ):
+        statement_handler( nullptr )
+    {
+        int error_code = sqlite3_prepare_v2( db_handler , sql_statement , -1 , &( this->statement_handler ) , nullptr );
+        if ( error_code != SQLITE_OK )
+        {
+            sqlite3_finalize( this->statement_handler );
+            throw std::runtime_error( std::string( "prepare statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( error_code ) );
+        }
+    }
+
+    SqlStatement::~SqlStatement()
+    {
+        sqlite3_finalize( this->statement_handler );
+    }
+
+    sqlite3_stmt * SqlStatement::get( void ) const
+    {
+        return this->statement_handler;
+    }
+
+    ScopedStatement::ScopedStatement( SqlStatement& _statement ):
+        statement( _statement )
+    {
+    }
+
+    ScopedStatement::~ScopedStatement()
+    {
+        //ready for next use,whether the step finished or thrown halfway
+        sqlite3_reset( this->statement.get() );
+        sqlite3_clear_bindings( this->statement.get() );
+    }
+
+    sqlite3_stmt * ScopedStatement::get( void ) const
+    {
+        return this->statement.get();
+    }
+
+    DataBase::DataBase( std::string filename , SYNCHRONOUS_MODE synchronous ):
         db_filename(filename)
     {
         this->sqlite3_error_code = sqlite3_open_v2( this->db_filename.c_str() , &( this->db_handler ) 
             , SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE , nullptr );
         if (  this->sqlite3_error_code != SQLITE_OK )
+        {
+            sqlite3_close( this->db_handler );
             throw std::runtime_error( std::string( "open file:" ) + filename + std::string( " failure,slite3 error code:" ) + std::to_string(  this->sqlite3_error_code ) );
-        create_tables();
+        }
+        try
+        {
+            //commit append to the write-ahead log,one sync per transaction at most
+            sqlite3_exec( this->db_handler , "PRAGMA journal_mode = WAL" , nullptr , nullptr , nullptr );
+            this->set_synchronous( synchronous );
+            create_tables();
+        }
+        catch ( ... )
+        {
+            //destructor is not called for a throwing constructor
+            this->statements.clear();
+            sqlite3_close( this->db_handler );
+            throw ;
+        }
     }
 
     DataBase::~DataBase()
     {
-        sqlite3_exec( this->db_handler , "VACUUM" , nullptr , nullptr , nullptr );
+        //cached statement must be finalized before close
+        this->statements.clear();
         this->sqlite3_error_code = sqlite3_close( db_handler );
         while( this->sqlite3_error_code == SQLITE_BUSY )
         {
             this->sqlite3_error_code = SQLITE_OK;
-            this->sql_statement_handler = sqlite3_next_stmt( this->db_handler , nullptr );
-            if ( this->sql_statement_handler != nullptr )
+            sqlite3_stmt * statement_handler = sqlite3_next_stmt( this->db_handler , nullptr );
+            if ( statement_handler != nullptr )
             {
-                this->sqlite3_error_code = sqlite3_finalize( this->sql_statement_handler );
+                this->sqlite3_error_code = sqlite3_finalize( statement_handler );
                 if ( this->sqlite3_error_code == SQLITE_OK )
                     this->sqlite3_error_code = sqlite3_close( db_handler );
             }
@@ -46,6 +107,86 @@ namespace MagicTower
         }
     }
 
+    void DataBase::set_synchronous( SYNCHRONOUS_MODE synchronous )
+    {
+        const char * sql_statement = "PRAGMA synchronous = FULL";
+        switch ( synchronous )
+        {
+            case SYNCHRONOUS_MODE::OFF:
+                sql_statement = "PRAGMA synchronous = OFF";
+                break;
+            case SYNCHRONOUS_MODE::NORMAL:
+                sql_statement = "PRAGMA synchronous = NORMAL";
+                break;
+            default :
+                break;
+        }
+        this->execute( sql_statement );
+    }
+
+    void DataBase::maintenance( void )
+    {
+        //fold the log back into the database file
+        this->execute( "PRAGMA wal_checkpoint(TRUNCATE)" );
+        //rebuild the file without free page,rewrite the whole file so only worth it when a quarter is free
+        std::int64_t free_pages = this->query_integer( "PRAGMA freelist_count" );
+        std::int64_t total_pages = this->query_integer( "PRAGMA page_count" );
+        if ( free_pages < vacuum_free_pages || free_pages*4 < total_pages )
+            return ;
+        this->execute( "VACUUM" );
+        this->execute( "PRAGMA wal_checkpoint(TRUNCATE)" );
+    }
+
+    void DataBase::execute( const char * sql_statement )
+    {
+        char * error_message = nullptr;
+        this->sqlite3_error_code = sqlite3_exec( this->db_handler , sql_statement , nullptr , nullptr , &error_message );
+        if ( this->sqlite3_error_code != SQLITE_OK )
+        {
+            std::string message = ( error_message != nullptr ) ? std::string( error_message ) : std::string();
+            sqlite3_free( error_message );
+            throw std::runtime_error( std::string( "execute statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) +
+                std::to_string( this->sqlite3_error_code ) + std::string( "," ) + message );
+        }
+    }
+
+    std::int64_t DataBase::query_integer( const char * sql_statement )
+    {
+        ScopedStatement statement = this->prepare( sql_statement );
+        this->sqlite3_error_code = sqlite3_step( statement.get() );
+        if ( this->sqlite3_error_code != SQLITE_ROW )
+        {
+            throw std::runtime_error( std::string( "evaluate statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
+        }
+        return sqlite3_column_int64( statement.get() , 0 );
+    }
+
+    ScopedStatement DataBase::prepare( const char * sql_statement )
+    {
+        auto iter = this->statements.find( sql_statement );
+        if ( iter == this->statements.end() )
+        {
+            iter = this->statements.emplace( sql_statement , std::make_unique<SqlStatement>( this->db_handler , sql_statement ) ).first;
+        }
+        return ScopedStatement( *( iter->second ) );
+    }
+
+    void DataBase::transaction( const std::function<void()>& writer )
+    {
+        //take the write lock at begin,not upgrade halfway
+        this->execute( "BEGIN IMMEDIATE TRANSACTION" );
+        try
+        {
+            writer();
+            this->execute( "COMMIT TRANSACTION" );
+        }
+        catch ( ... )
+        {
+            sqlite3_exec( this->db_handler , "ROLLBACK TRANSACTION" , nullptr , nullptr , nullptr );
+            throw ;
+        }
+    }
+
     void DataBase::create_tables()
     {
         const char * create_table_sqls[] = 
@@ -61,7 +202,8 @@ namespace MagicTower
                     fv_x                INT (32),
                     fv_y                INT (32),
                     name                TEXT,
-                    content             BLOB
+                    content             BLOB,
+                    fv_shape            INT (32)
                 );
             )",
             R"(
@@ -93,10 +235,26 @@ namespace MagicTower
                     item_id      INTEGER  PRIMARY KEY AUTOINCREMENT,
                     item_number  INT(32)
                 );
+            )",
+            //grids differ from the baseline tower,replace towerfloor rows
+            R"(
+                CREATE TABLE IF NOT EXISTS tower_delta (
+                    id              INTEGER  PRIMARY KEY,
+                    baseline_hash   INT (64),
+                    content         BLOB
+                );
             )"
         };
         for ( size_t i = 0 ; i < sizeof( create_table_sqls )/sizeof( const char * ) ; i++ )
             sqlite3_exec( this->db_handler , create_table_sqls[i] , nullptr , nullptr , nullptr );
+
+        //archive created before fv_shape column added
+        sqlite3_stmt * column_check = nullptr;
+        if ( sqlite3_prepare_v2( this->db_handler , "SELECT fv_shape FROM towerfloor LIMIT 0" , -1 , &column_check , nullptr ) != SQLITE_OK )
+        {
+            sqlite3_exec( this->db_handler , "ALTER TABLE towerfloor ADD COLUMN fv_shape INT (32)" , nullptr , nullptr , nullptr );
+        }
+        sqlite3_finalize( column_check );
     }
 
     Hero DataBase::get_hero_info( std::size_t archive_id )
@@ -104,127 +262,107 @@ namespace MagicTower
         Hero hero;
         const char sql_statement[] = "SELECT floors,x,y,level,life,attack,defense,gold,experience,yellow_key,"
         "blue_key,red_key,direction FROM hero WHERE id = ?";
-        this->sqlite3_error_code = sqlite3_prepare_v2( db_handler , sql_statement
-            , sizeof( sql_statement ) , &( this->sql_statement_handler ) , nullptr );
-        if ( this->sqlite3_error_code != SQLITE_OK )
-        {
-            sqlite3_finalize( this->sql_statement_handler );
-            throw std::runtime_error( std::string( "prepare statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
-        }
-        this->sqlite3_error_code = sqlite3_bind_int( this->sql_statement_handler , 1 , archive_id );
+        ScopedStatement statement = this->prepare( sql_statement );
+        sqlite3_stmt * statement_handler = statement.get();
+        this->sqlite3_error_code = sqlite3_bind_int( statement_handler , 1 , archive_id );
         if ( this->sqlite3_error_code != SQLITE_OK )
         {
-            this->sqlite3_error_code = sqlite3_finalize( this->sql_statement_handler );
             throw std::runtime_error( std::string( "bind statement:\"" ) + std::string( sql_statement ) + std::string( "\" failure,sqlite error code:" ) + std::to_string( this->sqlite3_error_code ) );
         }
 
         //id should be unique,so hero will not be repeat setting
-        while ( ( this->sqlite3_error_code = sqlite3_step( this->sql_statement_handler ) ) == SQLITE_ROW )
+        while ( ( this->sqlite3_error_code = sqlite3_step( statement_handler ) ) == SQLITE_ROW )
         {
-            if ( sqlite3_column_count( this->sql_statement_handler ) != 13 )
+            if ( sqlite3_column_count( statement_handler ) != 13 )
             {
-                sqlite3_finalize( this->sql_statement_handler );
                 throw std::runtime_error( std::string( sql_statement ) );
             }
-            hero.floors = sqlite3_column_int( this->sql_statement_handler , 0 );
-            hero.x = sqlite3_column_int( this->sql_statement_handler , 1 );
-            hero.y = sqlite3_column_int( this->sql_statement_handler , 2 );
-            hero.level = sqlite3_column_int( this->sql_statement_handler , 3 );
-            hero.life = sqlite3_column_int( this->sql_statement_handler , 4 );
-            hero.attack = sqlite3_column_int( this->sql_statement_handler , 5 );
-            hero.defense = sqlite3_column_int( this->sql_statement_handler , 6 );
-            hero.gold = sqlite3_column_int( this->sql_statement_handler , 7 );
-            hero.experience = sqlite3_column_int( this->sql_statement_handler , 8 );
-            hero.yellow_key = sqlite3_column_int( this->sql_statement_handler , 9 );
-            hero.blue_key = sqlite3_column_int( this->sql_statement_handler , 10 );
-            hero.red_key = sqlite3_column_int( this->sql_statement_handler , 11 );
-            hero.direction = static_cast<DIRECTION>( sqlite3_column_int( this->sql_statement_handler , 12 ) );
+            hero.floors = sqlite3_column_int( statement_handler , 0 );
+            hero.x = sqlite3_column_int( statement_handler , 1 );
+            hero.y = sqlite3_column_int( statement_handler , 2 );
+            hero.level = sqlite3_column_int( statement_handler , 3 );
+            hero.life = sqlite3_column_int( statement_handler , 4 );
+            hero.attack = sqlite3_column_int( statement_handler , 5 );
+            hero.defense = sqlite3_column_int( statement_handler , 6 );
+            hero.gold = sqlite3_column_int( statement_handler , 7 );
+            hero.experience = sqlite3_column_int( statement_handler , 8 );
+            hero.yellow_key = sqlite3_column_int( statement_handler , 9 );
+            hero.blue_key = sqlite3_column_int( statement_handler , 10 );
+            hero.red_key = sqlite3_column_int( statement_handler , 11 );
+            hero.direction = static_cast<DIRECTION>( sqlite3_column_int( statement_handler , 12 ) );
         }
 
         if ( this->sqlite3_error_code != SQLITE_DONE )
         {
-            sqlite3_finalize( this->sql_statement_handler );
             throw std::runtime_error( std::string( "evaluate statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
         }
-        this->sqlite3_error_code = sqlite3_finalize( this->sql_statement_handler );
-        if ( this->sqlite3_error_code != SQLITE_OK )
-        {
-            throw std::runtime_error( std::string( "finalize statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
-        }
         return hero;
     }
 
     TowerMap DataBase::get_tower_info()
     {
-        const char sql_statement[] = "SELECT id,length,width,default_floorid,tp_x,tp_y,fv_x,fv_y,name,content FROM towerfloor";
-        this->sqlite3_error_code = sqlite3_prepare_v2( db_handler , sql_statement
-            , sizeof( sql_statement ) , &( this->sql_statement_handler ) , nullptr );
-        if ( this->sqlite3_error_code != SQLITE_OK )
-        {
-            sqlite3_finalize( this->sql_statement_handler );
-            throw std::runtime_error( std::string( "prepare statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
-        }
+        const char sql_statement[] = "SELECT id,length,width,default_floorid,tp_x,tp_y,fv_x,fv_y,name,content,fv_shape FROM towerfloor";
+        ScopedStatement statement = this->prepare( sql_statement );
+        sqlite3_stmt * statement_handler = statement.get();
 
         TowerMap towers = {};
         //id should be unique,so hero will not be repeat setting
-        while ( ( this->sqlite3_error_code = sqlite3_step( this->sql_statement_handler ) ) == SQLITE_ROW )
+        while ( ( this->sqlite3_error_code = sqlite3_step( statement_handler ) ) == SQLITE_ROW )
         {
-            if ( sqlite3_column_count( this->sql_statement_handler ) != 10 )
+            if ( sqlite3_column_count( statement_handler ) != 11 )
             {
-                sqlite3_finalize( this->sql_statement_handler );
                 throw std::runtime_error( std::string( sql_statement ) );
             }
 
-            std::uint32_t floor_id = sqlite3_column_int( this->sql_statement_handler , 0 );
-            std::uint32_t floor_length = sqlite3_column_int( this->sql_statement_handler , 1 );
-            std::uint32_t floor_width = sqlite3_column_int( this->sql_statement_handler , 2 );
-            std::uint32_t default_floorid = sqlite3_column_int( this->sql_statement_handler , 3 );
+            std::uint32_t floor_id = sqlite3_column_int( statement_handler , 0 );
+            std::uint32_t floor_length = sqlite3_column_int( statement_handler , 1 );
+            std::uint32_t floor_width = sqlite3_column_int( statement_handler , 2 );
+            std::uint32_t default_floorid = sqlite3_column_int( statement_handler , 3 );
             decltype( TowerFloor::teleport_point ) tp_point;
-            if ( ( sqlite3_column_type( this->sql_statement_handler , 4 ) == SQLITE_NULL ) || 
-                 ( sqlite3_column_type( this->sql_statement_handler , 5 ) == SQLITE_NULL )
+            if ( ( sqlite3_column_type( statement_handler , 4 ) == SQLITE_NULL ) || 
+                 ( sqlite3_column_type( statement_handler , 5 ) == SQLITE_NULL )
             )
             {
                 tp_point = std::nullopt;
             }
             else
             {
-                tp_point = { sqlite3_column_int( this->sql_statement_handler , 4 ) , sqlite3_column_int( this->sql_statement_handler , 5 ) };
+                tp_point = { sqlite3_column_int( statement_handler , 4 ) , sqlite3_column_int( statement_handler , 5 ) };
             }
             decltype( TowerFloor::field_vision ) field_vision;
-            if ( ( sqlite3_column_type( this->sql_statement_handler , 6 ) == SQLITE_NULL ) || 
-                 ( sqlite3_column_type( this->sql_statement_handler , 7 ) == SQLITE_NULL )
+            if ( ( sqlite3_column_type( statement_handler , 6 ) == SQLITE_NULL ) || 
+                 ( sqlite3_column_type( statement_handler , 7 ) == SQLITE_NULL )
             )
             {
                 field_vision = std::nullopt;
             }
             else
             {
-                field_vision = { sqlite3_column_int( this->sql_statement_handler , 6 ) , sqlite3_column_int( this->sql_statement_handler , 7 ) };
+                field_vision = { sqlite3_column_int( statement_handler , 6 ) , sqlite3_column_int( statement_handler , 7 ) };
             }
-            std::string floor_name( reinterpret_cast< const char * >( sqlite3_column_text( this->sql_statement_handler , 8 ) ) );
-            //default vector size is 0,resize to >= maps size
-            //data size is agreed in advance,so don't call sqlite3_column_bytes.
-            struct TowerGrid * data = reinterpret_cast<struct TowerGrid *>( const_cast<void *>( sqlite3_column_blob( this->sql_statement_handler , 9 ) ) );
-            decltype( TowerFloor::content ) temp( data + 0 , data + floor_length*floor_width );
+            //NULL in old archive,sqlite3_column_int return 0(VISION_SHAPE::BOX)
+            VISION_SHAPE vision_shape = static_cast<VISION_SHAPE>( sqlite3_column_int( statement_handler , 10 ) );
+            if ( vision_shape > VISION_SHAPE::SIGHT )
+                vision_shape = VISION_SHAPE::BOX;
+            std::string floor_name( reinterpret_cast< const char * >( sqlite3_column_text( statement_handler , 8 ) ) );
+            //blob then bytes,see sqlite3_column_bytes
+            const void * data = sqlite3_column_blob( statement_handler , 9 );
+            std::size_t data_size = sqlite3_column_bytes( statement_handler , 9 );
+            decltype( TowerFloor::content ) temp = decode_floor_content( data , data_size ,
+                static_cast<std::size_t>( floor_length )*floor_width );
             towers.map[floor_id].length = floor_length;
             towers.map[floor_id].width = floor_width;
             towers.map[floor_id].default_floorid = default_floorid;
             towers.map[floor_id].teleport_point = tp_point;
             towers.map[floor_id].field_vision = field_vision;
+            towers.map[floor_id].vision_shape = vision_shape;
             towers.map[floor_id].name = floor_name;
             towers.map[floor_id].content = temp;
         }
         if ( this->sqlite3_error_code != SQLITE_DONE )
         {
-            sqlite3_finalize( this->sql_statement_handler );
             throw std::runtime_error( std::string( "evaluate statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
         }
-
-        this->sqlite3_error_code = sqlite3_finalize( this->sql_statement_handler );
-        if ( this->sqlite3_error_code != SQLITE_OK )
-        {
-            throw std::runtime_error( std::string( "finalize statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
-        }
         return towers;
     }
 
@@ -232,38 +370,25 @@ namespace MagicTower
     {
         std::map<std::string , std::uint32_t> script_flags;
         const char sql_statement[] = "SELECT flag_name , flag_value FROM script_flags";
-        this->sqlite3_error_code = sqlite3_prepare_v2( db_handler , sql_statement
-            , sizeof( sql_statement ) , &( this->sql_statement_handler ) , nullptr );
-        if ( this->sqlite3_error_code != SQLITE_OK )
-        {
-            sqlite3_finalize( this->sql_statement_handler );
-            throw std::runtime_error( std::string( "prepare statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
-        }
+        ScopedStatement statement = this->prepare( sql_statement );
+        sqlite3_stmt * statement_handler = statement.get();
 
-        while ( ( this->sqlite3_error_code = sqlite3_step( this->sql_statement_handler ) ) == SQLITE_ROW )
+        while ( ( this->sqlite3_error_code = sqlite3_step( statement_handler ) ) == SQLITE_ROW )
         {
-            if ( sqlite3_column_count( this->sql_statement_handler ) != 2 )
+            if ( sqlite3_column_count( statement_handler ) != 2 )
             {
-                sqlite3_finalize( this->sql_statement_handler );
                 throw std::runtime_error( std::string( sql_statement ) );
             }
 
-            std::string flag_name( reinterpret_cast< const char * >( sqlite3_column_text( this->sql_statement_handler , 0 ) ) );
-            std::uint32_t flag_value = sqlite3_column_int( this->sql_statement_handler , 1 );
+            std::string flag_name( reinterpret_cast< const char * >( sqlite3_column_text( statement_handler , 0 ) ) );
+            std::uint32_t flag_value = sqlite3_column_int( statement_handler , 1 );
             script_flags[flag_name] = flag_value;
         }
         
         if ( this->sqlite3_error_code != SQLITE_DONE )
         {
-            sqlite3_finalize( this->sql_statement_handler );
             throw std::runtime_error( std::string( "evaluate statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
         }
-        this->sqlite3_error_code = sqlite3_finalize( this->sql_statement_handler );
-        if ( this->sqlite3_error_code != SQLITE_OK )
-        {
-            throw std::runtime_error( std::string( "finalize statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
-        }
-
         return script_flags;
     }
 
@@ -271,38 +396,25 @@ namespace MagicTower
     {
         std::map<std::uint32_t , std::uint32_t> inventories;
         const char sql_statement[] = "SELECT item_id , item_number FROM inventories";
-        this->sqlite3_error_code = sqlite3_prepare_v2( db_handler , sql_statement
-            , sizeof( sql_statement ) , &( this->sql_statement_handler ) , nullptr );
-        if ( this->sqlite3_error_code != SQLITE_OK )
-        {
-            sqlite3_finalize( this->sql_statement_handler );
-            throw std::runtime_error( std::string( "prepare statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
-        }
+        ScopedStatement statement = this->prepare( sql_statement );
+        sqlite3_stmt * statement_handler = statement.get();
 
-        while ( ( this->sqlite3_error_code = sqlite3_step( this->sql_statement_handler ) ) == SQLITE_ROW )
+        while ( ( this->sqlite3_error_code = sqlite3_step( statement_handler ) ) == SQLITE_ROW )
         {
-            if ( sqlite3_column_count( this->sql_statement_handler ) != 2 )
+            if ( sqlite3_column_count( statement_handler ) != 2 )
             {
-                sqlite3_finalize( this->sql_statement_handler );
                 throw std::runtime_error( std::string( sql_statement ) );
             }
 
-            std::uint32_t item_id = sqlite3_column_int( this->sql_statement_handler , 0 );
-            std::uint32_t item_number = sqlite3_column_int( this->sql_statement_handler , 1 );
+            std::uint32_t item_id = sqlite3_column_int( statement_handler , 0 );
+            std::uint32_t item_number = sqlite3_column_int( statement_handler , 1 );
             inventories[item_id] = item_number;
         }
         
         if ( this->sqlite3_error_code != SQLITE_DONE )
         {
-            sqlite3_finalize( this->sql_statement_handler );
             throw std::runtime_error( std::string( "evaluate statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
         }
-        this->sqlite3_error_code = sqlite3_finalize( this->sql_statement_handler );
-        if ( this->sqlite3_error_code != SQLITE_OK )
-        {
-            throw std::runtime_error( std::string( "finalize statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
-        }
-
         return inventories;
     }
 
@@ -313,226 +425,178 @@ namespace MagicTower
         the parser allows the use of the single keyword REPLACE as an alias for "INSERT OR REPLACE".
     */
 
-    void DataBase::set_hero_info( const Hero& hero , std::size_t archive_id )
+    void DataBase::write_hero_info( const Hero& hero , std::size_t archive_id )
     {
         const char sql_statement[] = "INSERT OR REPLACE INTO hero(id,floors,x,y,level,life,attack,defense,"
             "gold,experience,yellow_key,blue_key,red_key,direction) VALUES( ? , ? , ? , ? , ? , ? , ? , ? , ? , ? , ? , ? , ? , ? )";
-        this->sqlite3_error_code = sqlite3_prepare_v2( this->db_handler , 
-        sql_statement , sizeof( sql_statement ) , &( this->sql_statement_handler ) , nullptr );
-
-        if ( this->sqlite3_error_code != SQLITE_OK )
-        {
-            sqlite3_finalize( this->sql_statement_handler );
-            throw std::runtime_error( std::string( "prepare statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
-        }
+        ScopedStatement statement = this->prepare( sql_statement );
+        sqlite3_stmt * statement_handler = statement.get();
         
-        if ( sqlite3_bind_parameter_count( this->sql_statement_handler ) != 14 )
+        if ( sqlite3_bind_parameter_count( statement_handler ) != 14 )
         {
-            sqlite3_finalize( this->sql_statement_handler );
             throw std::runtime_error( std::string( "sql statement:\"" ) + std::string( sql_statement ) + std::string( "\" bind argument count out of expectation" ) );
         }
 
-        sqlite3_bind_int( this->sql_statement_handler , 1 , archive_id );
-        sqlite3_bind_int( this->sql_statement_handler , 2 , hero.floors );
-        sqlite3_bind_int( this->sql_statement_handler , 3 , hero.x );
-        sqlite3_bind_int( this->sql_statement_handler , 4 , hero.y );
-        sqlite3_bind_int( this->sql_statement_handler , 5 , hero.level );
-        sqlite3_bind_int( this->sql_statement_handler , 6 , hero.life );
-        sqlite3_bind_int( this->sql_statement_handler , 7 , hero.attack );
-        sqlite3_bind_int( this->sql_statement_handler , 8 , hero.defense );
-        sqlite3_bind_int( this->sql_statement_handler , 9 , hero.gold );
-        sqlite3_bind_int( this->sql_statement_handler , 10 , hero.experience );
-        sqlite3_bind_int( this->sql_statement_handler , 11 , hero.yellow_key );
-        sqlite3_bind_int( this->sql_statement_handler , 12 , hero.blue_key );
-        sqlite3_bind_int( this->sql_statement_handler , 13 , hero.red_key );
-        sqlite3_bind_int( this->sql_statement_handler , 14 , static_cast<int>( hero.direction ) );
+        sqlite3_bind_int( statement_handler , 1 , archive_id );
+        sqlite3_bind_int( statement_handler , 2 , hero.floors );
+        sqlite3_bind_int( statement_handler , 3 , hero.x );
+        sqlite3_bind_int( statement_handler , 4 , hero.y );
+        sqlite3_bind_int( statement_handler , 5 , hero.level );
+        sqlite3_bind_int( statement_handler , 6 , hero.life );
+        sqlite3_bind_int( statement_handler , 7 , hero.attack );
+        sqlite3_bind_int( statement_handler , 8 , hero.defense );
+        sqlite3_bind_int( statement_handler , 9 , hero.gold );
+        sqlite3_bind_int( statement_handler , 10 , hero.experience );
+        sqlite3_bind_int( statement_handler , 11 , hero.yellow_key );
+        sqlite3_bind_int( statement_handler , 12 , hero.blue_key );
+        sqlite3_bind_int( statement_handler , 13 , hero.red_key );
+        sqlite3_bind_int( statement_handler , 14 , static_cast<int>( hero.direction ) );
 
         //UPDATE not return data so sqlite3_step not return SQLITE_ROW
-        this->sqlite3_error_code = sqlite3_step( this->sql_statement_handler );
+        this->sqlite3_error_code = sqlite3_step( statement_handler );
         if ( this->sqlite3_error_code != SQLITE_DONE )
         {
-            sqlite3_finalize( this->sql_statement_handler );
             throw std::runtime_error( std::string( "evaluate statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
         }
-
-        this->sqlite3_error_code = sqlite3_finalize( this->sql_statement_handler );
-        if ( this->sqlite3_error_code != SQLITE_OK )
-        {
-            throw std::runtime_error( std::string( "finalize statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
-        }
     }
 
-    void DataBase::set_tower_info( const TowerMap& tower )
+    std::optional<TowerDelta> DataBase::get_tower_delta( std::uint64_t baseline_hash )
     {
-        const char sql_statement[] = "INSERT OR REPLACE INTO towerfloor(id,length,width,default_floorid,tp_x,tp_y,fv_x,fv_y,name,content) VALUES( ? , ? , ? , ? , ? , ? , ? , ? , ? , ? )";
-        this->sqlite3_error_code = sqlite3_prepare_v2( this->db_handler , 
-        sql_statement , sizeof( sql_statement ) , &( this->sql_statement_handler ) , nullptr );
+        const char sql_statement[] = "SELECT baseline_hash,content FROM tower_delta WHERE id = 0";
+        ScopedStatement statement = this->prepare( sql_statement );
+        sqlite3_stmt * statement_handler = statement.get();
 
-        if ( this->sqlite3_error_code != SQLITE_OK )
+        this->sqlite3_error_code = sqlite3_step( statement_handler );
+        if ( this->sqlite3_error_code == SQLITE_DONE )
+            return std::nullopt;
+        if ( this->sqlite3_error_code != SQLITE_ROW )
         {
-            sqlite3_finalize( this->sql_statement_handler );
-            throw std::runtime_error( std::string( "prepare statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
+            throw std::runtime_error( std::string( "evaluate statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
         }
-        
-        if ( sqlite3_bind_parameter_count( this->sql_statement_handler ) != 10 )
+        if ( static_cast<std::uint64_t>( sqlite3_column_int64( statement_handler , 0 ) ) != baseline_hash )
         {
-            sqlite3_finalize( this->sql_statement_handler );
-            throw std::runtime_error( std::string( "sql statement:\"" ) + std::string( sql_statement ) + std::string( "\" bind argument count out of expectation" ) );
-        }
-
-        for ( auto& floor : tower.map )
-        {
-            sqlite3_bind_int( this->sql_statement_handler , 1 , floor.first );
-            sqlite3_bind_int( this->sql_statement_handler , 2 , floor.second.length );
-            sqlite3_bind_int( this->sql_statement_handler , 3 , floor.second.width );
-            sqlite3_bind_int( this->sql_statement_handler , 4 , floor.second.default_floorid );
-            if ( floor.second.teleport_point.has_value() )
-            {
-                sqlite3_bind_int( this->sql_statement_handler , 5 , floor.second.teleport_point.value().x );
-                sqlite3_bind_int( this->sql_statement_handler , 6 , floor.second.teleport_point.value().y );
-            }
-            else
-            {
-                sqlite3_bind_null( this->sql_statement_handler , 5 );
-                sqlite3_bind_null( this->sql_statement_handler , 6 );
-            }
-            if ( floor.second.field_vision.has_value() )
-            {
-                sqlite3_bind_int( this->sql_statement_handler , 7 , floor.second.field_vision.value().x );
-                sqlite3_bind_int( this->sql_statement_handler , 8 , floor.second.field_vision.value().y );
-            }
-            else
-            {
-                sqlite3_bind_null( this->sql_statement_handler , 7 );
-                sqlite3_bind_null( this->sql_statement_handler , 8 );
-            }
-            sqlite3_bind_text( this->sql_statement_handler , 9 , floor.second.name.c_str() , floor.second.name.size() , SQLITE_STATIC );
-            sqlite3_bind_blob( this->sql_statement_handler , 10 , floor.second.content.data() ,
-                sizeof( MagicTower::TowerGrid )*floor.second.length*floor.second.width , SQLITE_STATIC );
-
-            //UPDATE not return data so sqlite3_step not return SQLITE_ROW
-            this->sqlite3_error_code = sqlite3_step( this->sql_statement_handler );
-            if ( this->sqlite3_error_code != SQLITE_DONE )
-            {
-                sqlite3_finalize( this->sql_statement_handler );
-                throw std::runtime_error( std::string( "evaluate statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
-            }
-            this->sqlite3_error_code = sqlite3_reset( this->sql_statement_handler );
-            if ( this->sqlite3_error_code != SQLITE_OK )
-            {
-                sqlite3_finalize( this->sql_statement_handler );
-                throw std::runtime_error( std::string( "reset statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
-            }
-            sqlite3_clear_bindings( this->sql_statement_handler );
+            throw std::runtime_error( std::string( "tower delta made from another gamemap" ) );
         }
+        const void * data = sqlite3_column_blob( statement_handler , 1 );
+        std::size_t data_size = sqlite3_column_bytes( statement_handler , 1 );
+        return decode_tower_delta( data , data_size );
+    }
 
-        this->sqlite3_error_code = sqlite3_finalize( this->sql_statement_handler );
-        if ( this->sqlite3_error_code != SQLITE_OK )
+    void DataBase::write_tower_delta( const TowerDelta& delta , std::uint64_t baseline_hash )
+    {
+        //the whole tower is in the delta,full floor rows are outdated
+        this->execute( "DELETE FROM towerfloor" );
+        const char sql_statement[] = "INSERT OR REPLACE INTO tower_delta(id,baseline_hash,content) VALUES( 0 , ? , ? )";
+        ScopedStatement statement = this->prepare( sql_statement );
+        sqlite3_stmt * statement_handler = statement.get();
+        sqlite3_bind_int64( statement_handler , 1 , static_cast<sqlite3_int64>( baseline_hash ) );
+        std::vector<std::uint8_t> content = encode_tower_delta( delta );
+        sqlite3_bind_blob( statement_handler , 2 , content.data() , content.size() , SQLITE_STATIC );
+        this->sqlite3_error_code = sqlite3_step( statement_handler );
+        if ( this->sqlite3_error_code != SQLITE_DONE )
         {
-            throw std::runtime_error( std::string( "finalize statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
+            throw std::runtime_error( std::string( "evaluate statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
         }
     }
 
-    void DataBase::set_script_flags( std::map<std::string , std::uint32_t>& flags )
+    void DataBase::write_script_flags( const std::map<std::string , std::uint32_t>& flags )
     {
-        sqlite3_exec( this->db_handler , "BEGIN TRANSACTION" , nullptr , nullptr , nullptr );
-
         //clear old flag,make sure flag_name all value unique
-        sqlite3_exec( this->db_handler , "DELETE FROM script_flags" , nullptr , nullptr , nullptr );
+        this->execute( "DELETE FROM script_flags" );
 
         const char sql_statement[] = "INSERT OR REPLACE INTO script_flags(flag_name,flag_value) VALUES( ? , ? )";
-        this->sqlite3_error_code = sqlite3_prepare_v2( this->db_handler , 
-        sql_statement , sizeof( sql_statement ) , &( this->sql_statement_handler ) , nullptr );
-
-        if ( this->sqlite3_error_code != SQLITE_OK )
-        {
-            sqlite3_finalize( this->sql_statement_handler );
-            throw std::runtime_error( std::string( "prepare statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
-        }
+        ScopedStatement statement = this->prepare( sql_statement );
+        sqlite3_stmt * statement_handler = statement.get();
         
-        if ( sqlite3_bind_parameter_count( this->sql_statement_handler ) != 2 )
+        if ( sqlite3_bind_parameter_count( statement_handler ) != 2 )
         {
-            sqlite3_finalize( this->sql_statement_handler );
             throw std::runtime_error( std::string( "sql statement:\"" ) + std::string( sql_statement ) + std::string( "\" bind argument count out of expectation" ) );
         }
 
         for( auto& flag : flags )
         {
-            sqlite3_bind_text( this->sql_statement_handler , 1 , flag.first.c_str() , flag.first.size() , SQLITE_STATIC );
-            sqlite3_bind_int64( this->sql_statement_handler , 2 , flag.second );
+            sqlite3_bind_text( statement_handler , 1 , flag.first.c_str() , flag.first.size() , SQLITE_STATIC );
+            sqlite3_bind_int64( statement_handler , 2 , flag.second );
 
             //UPDATE or INSERT not return data so sqlite3_step not return SQLITE_ROW
-            this->sqlite3_error_code = sqlite3_step( this->sql_statement_handler );
+            this->sqlite3_error_code = sqlite3_step( statement_handler );
             if ( this->sqlite3_error_code != SQLITE_DONE )
             {
-                sqlite3_finalize( this->sql_statement_handler );
                 throw std::runtime_error( std::string( "evaluate statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
             }
-            this->sqlite3_error_code = sqlite3_reset( this->sql_statement_handler );
+            this->sqlite3_error_code = sqlite3_reset( statement_handler );
             if ( this->sqlite3_error_code != SQLITE_OK )
             {
-                sqlite3_finalize( this->sql_statement_handler );
                 throw std::runtime_error( std::string( "reset statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
             }
-            sqlite3_clear_bindings( this->sql_statement_handler );
-        }
-        
-        sqlite3_exec( this->db_handler , "COMMIT TRANSACTION" , nullptr , nullptr , nullptr );
-        
-        this->sqlite3_error_code = sqlite3_finalize( this->sql_statement_handler );
-        if ( this->sqlite3_error_code != SQLITE_OK )
-        {
-            throw std::runtime_error( std::string( "finalize statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
+            sqlite3_clear_bindings( statement_handler );
         }
     }
 
-    void DataBase::set_inventories( std::map<std::uint32_t , std::uint32_t>& inventories )
+    void DataBase::write_inventories( const std::map<std::uint32_t , std::uint32_t>& inventories )
     {
-        sqlite3_exec( this->db_handler , "BEGIN TRANSACTION" , nullptr , nullptr , nullptr );
+        //item used up is not in the map any more
+        this->execute( "DELETE FROM inventories" );
 
         const char sql_statement[] = "INSERT OR REPLACE INTO inventories(item_id,item_number) VALUES( ? , ? )";
-        this->sqlite3_error_code = sqlite3_prepare_v2( this->db_handler , 
-        sql_statement , sizeof( sql_statement ) , &( this->sql_statement_handler ) , nullptr );
-
-        if ( this->sqlite3_error_code != SQLITE_OK )
-        {
-            sqlite3_finalize( this->sql_statement_handler );
-            throw std::runtime_error( std::string( "prepare statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
-        }
+        ScopedStatement statement = this->prepare( sql_statement );
+        sqlite3_stmt * statement_handler = statement.get();
         
-        if ( sqlite3_bind_parameter_count( this->sql_statement_handler ) != 2 )
+        if ( sqlite3_bind_parameter_count( statement_handler ) != 2 )
         {
-            sqlite3_finalize( this->sql_statement_handler );
             throw std::runtime_error( std::string( "sql statement:\"" ) + std::string( sql_statement ) + std::string( "\" bind argument count out of expectation" ) );
         }
 
         for( auto& item : inventories )
         {
-            sqlite3_bind_int( this->sql_statement_handler , 1 , item.first );
-            sqlite3_bind_int64( this->sql_statement_handler , 2 , item.second );
+            sqlite3_bind_int( statement_handler , 1 , item.first );
+            sqlite3_bind_int64( statement_handler , 2 , item.second );
 
             //UPDATE or INSERT not return data so sqlite3_step not return SQLITE_ROW
-            this->sqlite3_error_code = sqlite3_step( this->sql_statement_handler );
+            this->sqlite3_error_code = sqlite3_step( statement_handler );
             if ( this->sqlite3_error_code != SQLITE_DONE )
             {
-                sqlite3_finalize( this->sql_statement_handler );
                 throw std::runtime_error( std::string( "evaluate statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
             }
-            this->sqlite3_error_code = sqlite3_reset( this->sql_statement_handler );
+            this->sqlite3_error_code = sqlite3_reset( statement_handler );
             if ( this->sqlite3_error_code != SQLITE_OK )
             {
-                sqlite3_finalize( this->sql_statement_handler );
                 throw std::runtime_error( std::string( "reset statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
             }
-            sqlite3_clear_bindings( this->sql_statement_handler );
-        }
-        
-        sqlite3_exec( this->db_handler , "COMMIT TRANSACTION" , nullptr , nullptr , nullptr );
-        
-        this->sqlite3_error_code = sqlite3_finalize( this->sql_statement_handler );
-        if ( this->sqlite3_error_code != SQLITE_OK )
-        {
-            throw std::runtime_error( std::string( "finalize statement:" ) + std::string( sql_statement ) + std::string( " failure,slite3 error code:" ) + std::to_string( this->sqlite3_error_code ) );
+            sqlite3_clear_bindings( statement_handler );
         }
     }
+
+    void DataBase::set_hero_info( const Hero& hero , std::size_t archive_id )
+    {
+        this->transaction( [ & ](){ this->write_hero_info( hero , archive_id ); } );
+    }
+
+    void DataBase::set_script_flags( const std::map<std::string , std::uint32_t>& flags )
+    {
+        this->transaction( [ & ](){ this->write_script_flags( flags ); } );
+    }
+
+    void DataBase::set_inventories( const std::map<std::uint32_t , std::uint32_t>& inventories )
+    {
+        this->transaction( [ & ](){ this->write_inventories( inventories ); } );
+    }
+
+    void DataBase::save_snapshot( const TowerDelta& delta , std::uint64_t baseline_hash , const TowerGenerations& generations ,
+        const Hero& hero , const std::map<std::string , std::uint32_t>& flags , const std::map<std::uint32_t , std::uint32_t>& inventories )
+    {
+        //e.g. saved again after shopping,the tower row is still right
+        bool tower_changed = ( this->persisted_hash != baseline_hash ) || ( this->persisted_generations != generations );
+        this->transaction( [ & ]()
+        {
+            if ( tower_changed )
+                this->write_tower_delta( delta , baseline_hash );
+            this->write_hero_info( hero , 0 );
+            this->write_script_flags( flags );
+            this->write_inventories( inventories );
+        });
+        //only after commit,a rollback keep the old row
+        this->persisted_hash = baseline_hash;
+        this->persisted_generations = generations;
+    }
 }
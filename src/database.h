@@ -3,6 +3,10 @@
 #define DATABASE_H
 
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <string>
 #include <map>
 
@@ -13,10 +17,53 @@
 
 namespace MagicTower
 {
+    //PRAGMA synchronous in WAL mode,OFF:no sync,NORMAL:sync at checkpoint only,FULL:sync every commit
+    enum class SYNCHRONOUS_MODE:std::uint32_t
+    {
+        OFF = 0,
+        NORMAL = 1,
+        FULL = 2,
+    };
+
+    //prepared once,finalized with the connection
+    class SqlStatement
+    {
+    public:
+        SqlStatement( sqlite3 * db_handler , const char * sql_statement );
+        ~SqlStatement();
+        sqlite3_stmt * get( void ) const;
+
+        SqlStatement( const SqlStatement& )=delete;
+        SqlStatement( SqlStatement&& )=delete;
+        SqlStatement& operator=( const SqlStatement& )=delete;
+        SqlStatement& operator=( SqlStatement&& )=delete;
+    private:
+        sqlite3_stmt * statement_handler;
+    };
+
+    //one use of a cached statement,reset and unbind it on scope exit
+    class ScopedStatement
+    {
+    public:
+        ScopedStatement( SqlStatement& statement );
+        ~ScopedStatement();
+        sqlite3_stmt * get( void ) const;
+
+        ScopedStatement( const ScopedStatement& )=delete;
+        ScopedStatement( ScopedStatement&& )=delete;
+        ScopedStatement& operator=( const ScopedStatement& )=delete;
+        ScopedStatement& operator=( ScopedStatement&& )=delete;
+    private:
+        SqlStatement& statement;
+    };
+
+    //database run in WAL journal mode,every set_* and save_snapshot is one transaction.
+    //statements are prepared on first use and reused until the object destroyed,keep the object open across saves.
+    //archive store the tower as delta,full floor rows are read only( gamedata and old archive )
     class DataBase
     {
     public:
-        DataBase( std::string filename = std::string( "magictower.db" ) );
+        DataBase( std::string filename = std::string( "magictower.db" ) , SYNCHRONOUS_MODE synchronous = SYNCHRONOUS_MODE::FULL );
         ~DataBase();
 
         Hero get_hero_info( std::size_t archive_id );
@@ -25,9 +72,20 @@ namespace MagicTower
         std::map<std::uint32_t , std::uint32_t> get_inventories( void );
 
         void set_hero_info( const Hero& hero , std::size_t archive_id );
-        void set_tower_info( const TowerMap& tower );
-        void set_script_flags( std::map<std::string , std::uint32_t>& flags );
-        void set_inventories( std::map<std::uint32_t , std::uint32_t>& inventories );
+        void set_script_flags( const std::map<std::string , std::uint32_t>& flags );
+        void set_inventories( const std::map<std::uint32_t , std::uint32_t>& inventories );
+        //whole game state in one transaction,all or nothing.
+        //the grids differ from baseline tower,floor shape come from baseline.
+        //generations:the floors delta made from,the delta row is kept if no floor changed since the last save of this object
+        void save_snapshot( const TowerDelta& delta , std::uint64_t baseline_hash , const TowerGenerations& generations ,
+            const Hero& hero , const std::map<std::string , std::uint32_t>& flags , const std::map<std::uint32_t , std::uint32_t>& inventories );
+        //nullopt if the archive hold full floors,throw std::runtime_error if made from another baseline
+        std::optional<TowerDelta> get_tower_delta( std::uint64_t baseline_hash );
+
+        void set_synchronous( SYNCHRONOUS_MODE synchronous );
+        //checkpoint the log,VACUUM only if many free pages,not needed by save.
+        //SaveService run it on quit for the archives written
+        void maintenance( void );
 
     protected:
         DataBase( const DataBase& )=delete;
@@ -36,10 +94,26 @@ namespace MagicTower
         DataBase& operator=( const DataBase&& )=delete;
     private:
         void create_tables();
+        //throw std::runtime_error on failure
+        void execute( const char * sql_statement );
+        //first column of the first row,e.g. PRAGMA page_count
+        std::int64_t query_integer( const char * sql_statement );
+        //cached statement of the sql text,prepare on first use
+        ScopedStatement prepare( const char * sql_statement );
+        //rollback and rethrow if writer throw
+        void transaction( const std::function<void()>& writer );
+        void write_hero_info( const Hero& hero , std::size_t archive_id );
+        void write_tower_delta( const TowerDelta& delta , std::uint64_t baseline_hash );
+        void write_script_flags( const std::map<std::string , std::uint32_t>& flags );
+        void write_inventories( const std::map<std::uint32_t , std::uint32_t>& inventories );
         std::string db_filename;
         int sqlite3_error_code;
         sqlite3 * db_handler;
-        sqlite3_stmt * sql_statement_handler;
+        //sql text -> statement
+        std::map<std::string,std::unique_ptr<SqlStatement>> statements;
+        //tower of the delta row written by this object,nullopt until first save
+        std::optional<std::uint64_t> persisted_hash;
+        TowerGenerations persisted_generations;
     };
 }
 
@@ -1,9 +1,13 @@
+#include <cstdlib>
+#include <string>
+
 #include <glibmm.h>
 #include <giomm.h>
 
 #include <lua.hpp>
 
 #include "env_var.h"
+#include "game_event.h"
 #include "resources.h"
 
 namespace MagicTower
@@ -308,11 +312,19 @@ namespace MagicTower
             {
                 lua_getfield( L , top + 9 , "x" );
                 lua_getfield( L , top + 9 , "y" );
+                lua_getfield( L , top + 9 , "shape" );
                 //top + 10 has content table
                 std::uint32_t tp_x = luaL_checkinteger( L , top + 11 );
                 std::uint32_t tp_y = luaL_checkinteger( L , top + 12 );
-                lua_pop( L , 2 );
+                std::string shape = luaL_optstring( L , top + 13 , "box" );
+                lua_pop( L , 3 );
                 towers.map[floor_id].field_vision = { tp_x , tp_y };
+                if ( shape == "circle" )
+                    towers.map[floor_id].vision_shape = VISION_SHAPE::CIRCLE;
+                else if ( shape == "sight" )
+                    towers.map[floor_id].vision_shape = VISION_SHAPE::SIGHT;
+                else
+                    towers.map[floor_id].vision_shape = VISION_SHAPE::BOX;
             }
             else
             {
@@ -352,9 +364,18 @@ namespace MagicTower
         tips_content( {} ),
         inventories({}),
         script_flags(),
+        save_service(),
+        quick_saves(),
+        quickload_age( 0 ),
+        quicksave_flush( false ),
+        action_journal(),
+        autosave(),
+        play_time( 0 ),
+        play_start( g_get_monotonic_time() ),
         script_engines( luaL_newstate() , lua_close ),
         path( {} ),
         menu_items( {} ),
+        slot_menu_ids(),
         music( music_list ),
         soundeffect_player( std::vector<std::string>({}) ),
         state()
@@ -364,6 +385,12 @@ namespace MagicTower
         initial_sandbox( L );
         this->initial_gamedata();
 
+        //history depth,default 64 actions
+        std::string undo_depth = Glib::getenv( "MAGICTOWER_UNDO_DEPTH" );
+        if ( !undo_depth.empty() )
+            this->action_journal.set_depth( std::strtoul( undo_depth.c_str() , nullptr , 10 ) );
+        this->autosave.set_saver( [ this ](){ return autosave_game( this ); } );
+
         soundeffect_player.set_playmode(PLAY_MODE::SINGLE_PLAY);
     }
 
@@ -376,6 +403,11 @@ namespace MagicTower
         }
     }
 
+    std::int64_t GameStatus::get_play_time( void ) const
+    {
+        return this->play_time + ( g_get_monotonic_time() - this->play_start )/G_TIME_SPAN_SECOND;
+    }
+
     void GameStatus::initial_gamedata()
     {
         lua_State * L = this->script_engines.get();
@@ -385,6 +417,11 @@ namespace MagicTower
         this->monsters = initial_monsters( L );
         this->stairs = initial_stairs( L );
         this->game_map = initial_gamemap( L );
+        //save archive record the difference to it
+        this->save_service.set_baseline( this->game_map );
+        this->play_time = 0;
+        this->play_start = g_get_monotonic_time();
+        this->action_journal.clear( this->game_map );
 
         this->focus_item_id = 0;
         this->state = GAME_STATE::NORMAL;
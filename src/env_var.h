@@ -8,12 +8,17 @@
 #include <exception>
 #include <functional>
 #include <map>
+#include <memory>
 #include <vector>
 #include <string>
 
 #include "database.h"
 #include "music.h"
 #include "hero.h"
+#include "save_service.h"
+#include "quick_save.h"
+#include "action_journal.h"
+#include "autosave.h"
 #include "item.h"
 #include "monster.h"
 #include "stairs.h"
@@ -34,6 +39,8 @@ namespace MagicTower
         STORE_MENU,
         JUMP_MENU,
         INVENTORIES_MENU,
+        //floor thumbnails grid,open from jump menu
+        FLOOR_BROWSER,
         GAME_LOSE,
         GAME_WIN,
         GAME_END,
@@ -48,6 +55,8 @@ namespace MagicTower
         ~GameStatus();
 
         void initial_gamedata();
+        //second,counted across save and load
+        std::int64_t get_play_time( void ) const;
 
         bool draw_path;
         std::size_t focus_item_id;
@@ -61,9 +70,27 @@ namespace MagicTower
         std::map<std::uint32_t,std::uint32_t> inventories;
         std::map<std::string,std::uint32_t> script_flags;
         std::map<std::string,std::uint32_t> refmap;
+        //save archive I/O thread and connections
+        SaveService save_service;
+        //in memory quicksaves,floors shared with save_service snapshots
+        QuickSaveRing quick_saves;
+        //age of last quickload,Shift+F9 go one older
+        std::size_t quickload_age;
+        //write quicksave to archive slot 0 on the I/O thread too
+        bool quicksave_flush;
+        //undo/redo history,recorded per input event by ActionScope
+        ActionJournal action_journal;
+        //floor change and action count trigger autosave
+        AutosaveScheduler autosave;
+        //second played before play_start
+        std::int64_t play_time;
+        //g_get_monotonic_time of new game or load
+        std::int64_t play_start;
         std::unique_ptr< lua_State , decltype( &lua_close ) > script_engines;
         std::vector<TowerGridLocation> path;
         Menu_t menu_items;
+        //slot id of every item in save/load menu,0 for non slot item,empty in other menu
+        std::vector<std::size_t> slot_menu_ids;
         MusicPlayer music;
         MusicPlayer soundeffect_player;
         Hero hero;
@@ -1,3 +1,9 @@
+#include <cstdlib>
+#include <cstring>
+
+#include <memory>
+#include <optional>
+#include <string>
 #include <vector>
 
 #include <glibmm.h>
@@ -15,14 +21,40 @@ static GLogWriterOutput mt_log_writer( GLogLevelFlags log_level, const GLogField
     return G_LOG_WRITER_HANDLED;
 }
 
-int main( int , char * argv[] )
+int main( int argc , char * argv[] )
 {
+    //--headless-render[=output directory]:render all floors to png and render time csv,no display required
+    std::optional<std::string> render_dir;
+    for ( int i = 1 ; i < argc ; i++ )
+    {
+        const char * option = "--headless-render";
+        if ( std::strncmp( argv[i] , option , std::strlen( option ) ) != 0 )
+            continue;
+        const char * value = argv[i] + std::strlen( option );
+        render_dir = ( *value == '=' ) ? std::string( value + 1 ) : std::string( "render" );
+        //relative to the working directory,not the program directory
+        if ( !g_path_is_absolute( render_dir.value().c_str() ) )
+        {
+            std::unique_ptr< char , decltype( &g_free ) > current_dir( g_get_current_dir() , g_free );
+            std::unique_ptr< char , decltype( &g_free ) > absolute_path( g_build_filename( current_dir.get() , render_dir.value().c_str() , nullptr ) , g_free );
+            render_dir = std::string( absolute_path.get() );
+        }
+    }
+
     std::unique_ptr< char , decltype( &g_free ) > self_dir_path( g_path_get_dirname( argv[0] ) , g_free );
     g_chdir( self_dir_path.get() );
     g_log_set_writer_func( mt_log_writer , nullptr , nullptr );
 
-    MagicTower::GameWindow game;
-    game.run();
+    int exit_status = EXIT_SUCCESS;
+    if ( render_dir.has_value() )
+    {
+        exit_status = MagicTower::GameWindow::render_offscreen( render_dir.value() , 832 , 640 );
+    }
+    else
+    {
+        MagicTower::GameWindow game;
+        game.run();
+    }
 
     Glib::RefPtr<Gio::File> logfile = Gio::File::create_for_path( "magictower.log" );
     if ( logfile->query_exists() )
@@ -35,5 +67,5 @@ int main( int , char * argv[] )
     {
         output_streamer->write( log );
     }
-    return EXIT_SUCCESS;
+    return exit_status;
 }
@@ -1,5 +1,6 @@
 #include <cstdint>
 #include <cinttypes>
+#include <cstdio>
 
 #include <iterator>
 #include <map>
@@ -11,6 +12,8 @@
 #include <queue>
 #include <tuple>
 #include <algorithm>
+#include <optional>
+#include <stdexcept>
 
 #include <glibmm.h> //g_log
 #include <giomm.h>
@@ -25,6 +28,13 @@ namespace MagicTower
 {
     //floor , x , y
     position_t temp_pos;
+    //slot 1 .. save_slot_count in save/load menu
+    static const std::size_t save_slot_count = 8;
+    //archive slot of quicksave flush,not listed in menu
+    static const std::size_t quicksave_slot = 0;
+    //autosave rotate through autosave_first_slot .. autosave_first_slot + autosave_slot_count - 1,listed in load menu
+    static const std::size_t autosave_first_slot = 101;
+    static const std::size_t autosave_slot_count = 3;
 
     static bool open_door( GameStatus * game_status , position_t position );
     static bool change_floor( GameStatus * game_status , std::uint32_t stair_id );
@@ -41,6 +51,9 @@ namespace MagicTower
     static void set_inventories_menu( GameStatus * game_status );
     static void set_store_menu( GameStatus * game_status );
     static void set_sub_store_menu( GameStatus * game_status , std::uint32_t store_id );
+    static void set_slot_menu( GameStatus * game_status , bool save_mode );
+    static void make_save_directory( void );
+    static void sync_unlock_flags( GameStatus * game_status );
 
     // Helpers for TowerGridLocation
     static bool operator==( TowerGridLocation a , TowerGridLocation b )
@@ -547,6 +560,7 @@ namespace MagicTower
                     luaL_checktype( L , 1 , LUA_TTABLE );
                     GameStatus * game_status = ( GameStatus * )( lua_topointer( L , lua_upvalueindex( 1 ) ) );
                     game_status->menu_items = {};
+                    game_status->slot_menu_ids.clear();
                     lua_pushnil( L );
                     while( lua_next( L , 1 ) )
                     {
@@ -796,34 +810,22 @@ namespace MagicTower
 
     void save_game( GameStatus * game_status , size_t save_id )
     {
-        Glib::RefPtr<Gio::File> save_dir = Gio::File::create_for_path( ResourcesManager::get_save_path() );
-        try
-        {
-            save_dir->make_directory_with_parents();
-        }
-        catch( const Glib::Error& e )
-        {
-            //if dir exists,do nothing.
-            g_log( __func__ , G_LOG_LEVEL_WARNING , "%s" , e.what().c_str() );
-        }
+        make_save_directory();
 
-        std::string fail_tips = std::string( "保存存档:" ) + std::to_string( save_id ) + std::string( "失败" );
-        try
-        {
-            DataBase db( ResourcesManager::get_save_path() + std::to_string( save_id ) + std::string( ".db" ) );
-            db.set_tower_info( game_status->game_map );
-            db.set_hero_info( game_status->hero , 0 );
-            db.set_script_flags( game_status->script_flags );
-            db.set_inventories( game_status->inventories );
-        }
-        catch ( const std::runtime_error& e )
-        {
-            set_tips( game_status , fail_tips );
-            g_log( __func__ , G_LOG_LEVEL_MESSAGE , "%s" , e.what() );
-            return ;
-        }
-        std::string tips = std::string( "保存存档:" ) + std::to_string( save_id ) + std::string( "成功" );
-        set_tips( game_status , tips );
+        //written on I/O thread,play go on meanwhile
+        game_status->save_service.save( save_id , game_status->game_map , game_status->hero , game_status->script_flags , game_status->inventories ,
+            game_status->get_play_time() ,
+            [ game_status , save_id ]( bool success , const std::string& error_message )
+            {
+                if ( !error_message.empty() )
+                    g_log( "save_game" , G_LOG_LEVEL_MESSAGE , "%s" , error_message.c_str() );
+                if ( !success )
+                {
+                    set_tips( game_status , std::string( "保存存档:" ) + std::to_string( save_id ) + std::string( "失败" ) );
+                    return ;
+                }
+                set_tips( game_status , std::string( "保存存档:" ) + std::to_string( save_id ) + std::string( "成功" ) );
+            });
     }
 
     void load_game( GameStatus * game_status , size_t save_id )
@@ -838,43 +840,45 @@ namespace MagicTower
         }
         try
         {
-            DataBase db( ResourcesManager::get_save_path() + std::to_string( save_id ) + std::string( ".db" ) );
-            game_status->game_map = db.get_tower_info();
-            game_status->hero = db.get_hero_info( 0 );
-            game_status->script_flags = db.get_script_flags();
-            game_status->inventories = db.get_inventories();
-
-            //store unlock flag
-            for ( auto& store : game_status->stores )
+            //wait for the pending save of the archive
+            game_status->save_service.read( save_id , [ game_status ]( DataBase& db )
             {
-                std::string flag_name = std::string( "store_" ) + std::to_string( store.first );
-                if ( game_status->script_flags.find( flag_name ) != game_status->script_flags.end() )
+                //delta archive replay onto the baseline,old archive hold full floors
+                TowerMap tower;
+                std::optional<TowerDelta> delta = db.get_tower_delta( game_status->save_service.get_baseline_hash() );
+                if ( delta.has_value() )
                 {
-                    store.second.usability = true;
+                    tower = game_status->save_service.get_baseline();
+                    if ( !apply_tower_delta( tower , delta.value() ) )
+                        throw std::runtime_error( std::string( "tower delta out of gamemap" ) );
                 }
                 else
                 {
-                    store.second.usability = false;
+                    tower = db.get_tower_info();
                 }
-                
-            }
+                Hero hero = db.get_hero_info( 0 );
+                std::map<std::string , std::uint32_t> script_flags = db.get_script_flags();
+                std::map<std::uint32_t , std::uint32_t> inventories = db.get_inventories();
+                //every read succeeded,a broken archive leave the game as it is
+                game_status->game_map = std::move( tower );
+                game_status->hero = hero;
+                game_status->script_flags = std::move( script_flags );
+                game_status->inventories = std::move( inventories );
+            });
 
-            //floor jump unlock flag
-            for ( std::uint32_t i = 0 ; i < game_status->game_map.map.size() ; i++ )
-            {
-                std::string floor_flag = std::string( "floors_" ) + std::to_string( i );
-                if ( game_status->script_flags.find( floor_flag ) != game_status->script_flags.end() )
-                {
-                    game_status->access_floor[i] = true;
-                }
-                else
-                {
-                    game_status->access_floor[i] = false;
-                }
-            }
+            //archive without index row(saved by old version) restart the count
+            const std::map<std::size_t,SaveSlotInfo>& slots = game_status->save_service.get_slots();
+            auto slot_iter = slots.find( save_id );
+            game_status->play_time = ( slot_iter != slots.end() ) ? slot_iter->second.play_time : 0;
+            game_status->play_start = g_get_monotonic_time();
+
+            sync_unlock_flags( game_status );
+            game_status->action_journal.clear( game_status->game_map );
         }
         catch ( const std::runtime_error& e )
         {
+            //the open recording may not match the game any more
+            game_status->action_journal.clear( game_status->game_map );
             set_tips( game_status , fail_tips );
             g_log( __func__ , G_LOG_LEVEL_MESSAGE , "%s" , e.what() );
             return ;
@@ -883,6 +887,177 @@ namespace MagicTower
         set_tips( game_status , tips );
     }
 
+    bool autosave_game( GameStatus * game_status )
+    {
+        //not in the middle of dialog,message or menu
+        if ( game_status->state != GAME_STATE::NORMAL )
+            return false;
+        //don't queue behind a running save
+        if ( game_status->save_service.has_pending() )
+            return false;
+
+        //overwrite the oldest,a missing slot first
+        const std::map<std::size_t,SaveSlotInfo>& slots = game_status->save_service.get_slots();
+        std::size_t save_id = autosave_first_slot;
+        std::int64_t oldest = INT64_MAX;
+        for ( std::size_t slot_id = autosave_first_slot ; slot_id < autosave_first_slot + autosave_slot_count ; slot_id++ )
+        {
+            auto slot_iter = slots.find( slot_id );
+            std::int64_t timestamp = ( slot_iter != slots.end() ) ? slot_iter->second.timestamp : INT64_MIN;
+            if ( timestamp < oldest )
+            {
+                oldest = timestamp;
+                save_id = slot_id;
+            }
+        }
+
+        make_save_directory();
+        game_status->save_service.save_replace( save_id , game_status->game_map , game_status->hero , game_status->script_flags ,
+            game_status->inventories , game_status->get_play_time() ,
+            []( bool , const std::string& error_message )
+            {
+                if ( !error_message.empty() )
+                    g_log( "autosave_game" , G_LOG_LEVEL_MESSAGE , "%s" , error_message.c_str() );
+            });
+        return true;
+    }
+
+    void quick_save( GameStatus * game_status )
+    {
+        //no disk access,unchanged floors shared with the previous snapshot
+        QuickSnapshot snapshot = {
+            game_status->save_service.snapshot_tower( game_status->game_map ) ,
+            game_status->hero ,
+            game_status->script_flags ,
+            game_status->inventories ,
+            {} ,
+            game_status->access_floor ,
+            game_status->get_play_time()
+        };
+        for ( auto& store : game_status->stores )
+        {
+            snapshot.store_usability[ store.first ] = store.second.usability;
+        }
+        game_status->quick_saves.push( std::move( snapshot ) );
+        game_status->quickload_age = 0;
+
+        if ( game_status->quicksave_flush )
+        {
+            make_save_directory();
+            game_status->save_service.save( quicksave_slot , game_status->game_map , game_status->hero , game_status->script_flags ,
+                game_status->inventories , game_status->get_play_time() ,
+                []( bool , const std::string& error_message )
+                {
+                    if ( !error_message.empty() )
+                        g_log( "quick_save" , G_LOG_LEVEL_MESSAGE , "%s" , error_message.c_str() );
+                });
+        }
+        set_tips( game_status , std::string( "快速存档成功" ) );
+    }
+
+    void quick_load( GameStatus * game_status , bool older )
+    {
+        std::size_t age = older ? game_status->quickload_age + 1 : 0;
+        const QuickSnapshot * snapshot = game_status->quick_saves.get( age );
+        if ( snapshot == nullptr )
+        {
+            //new session,fall back to the flushed archive
+            if ( game_status->quick_saves.size() == 0 && Glib::file_test( ResourcesManager::get_save_path() +
+                std::to_string( quicksave_slot ) + std::string( ".db" ) , Glib::FILE_TEST_EXISTS ) )
+            {
+                load_game( game_status , quicksave_slot );
+                return ;
+            }
+            set_tips( game_status , older ? std::string( "没有更早的快速存档" ) : std::string( "没有快速存档" ) );
+            return ;
+        }
+
+        QuickSaveRing::restore_tower( game_status->game_map , snapshot->tower );
+        game_status->hero = snapshot->hero;
+        game_status->script_flags = snapshot->script_flags;
+        game_status->inventories = snapshot->inventories;
+        for ( auto& store : game_status->stores )
+        {
+            auto usability = snapshot->store_usability.find( store.first );
+            store.second.usability = ( usability != snapshot->store_usability.end() ) && usability->second;
+        }
+        game_status->access_floor = snapshot->access_floor;
+        game_status->play_time = snapshot->play_time;
+        game_status->play_start = g_get_monotonic_time();
+        game_status->path = {};
+        game_status->action_journal.clear( game_status->game_map );
+        game_status->quickload_age = age;
+        set_tips( game_status , std::string( "快速读档:" ) + std::to_string( age + 1 ) + std::string( "/" ) +
+            std::to_string( game_status->quick_saves.size() ) );
+    }
+
+    //hero stand on the tower,not in menu
+    static bool is_playing( GAME_STATE state )
+    {
+        switch ( state )
+        {
+            case GAME_STATE::NORMAL:
+            case GAME_STATE::FIND_PATH:
+            case GAME_STATE::DIALOG:
+            case GAME_STATE::MESSAGE:
+            case GAME_STATE::REVIEW_DETAIL:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    ActionScope::ActionScope( GameStatus * _game_status ):
+        game_status( _game_status ),
+        recording( is_playing( _game_status->state ) )
+    {
+        if ( !this->recording )
+            return ;
+        this->game_status->action_journal.begin( this->game_status->game_map , this->game_status->hero ,
+            this->game_status->script_flags , this->game_status->inventories );
+    }
+
+    ActionScope::~ActionScope()
+    {
+        if ( !this->recording )
+            return ;
+        //e.g. jump menu opened,hero is hidden
+        if ( !is_playing( this->game_status->state ) )
+        {
+            this->game_status->action_journal.cancel( this->game_status->game_map );
+            return ;
+        }
+        if ( this->game_status->action_journal.commit( this->game_status->game_map , this->game_status->hero ,
+            this->game_status->script_flags , this->game_status->inventories ) )
+        {
+            this->game_status->autosave.note_action();
+        }
+    }
+
+    void undo_action( GameStatus * game_status )
+    {
+        if ( !game_status->action_journal.undo( game_status->game_map , game_status->hero ,
+            game_status->script_flags , game_status->inventories ) )
+        {
+            set_tips( game_status , std::string( "没有可撤销的操作" ) );
+            return ;
+        }
+        sync_unlock_flags( game_status );
+        game_status->path = {};
+    }
+
+    void redo_action( GameStatus * game_status )
+    {
+        if ( !game_status->action_journal.redo( game_status->game_map , game_status->hero ,
+            game_status->script_flags , game_status->inventories ) )
+        {
+            set_tips( game_status , std::string( "没有可重做的操作" ) );
+            return ;
+        }
+        sync_unlock_flags( game_status );
+        game_status->path = {};
+    }
+
     std::int64_t get_combat_damage( GameStatus * game_status , std::uint32_t monster_id )
     {
         if ( game_status->monsters.find( monster_id ) == game_status->monsters.end() )
@@ -1109,6 +1284,7 @@ namespace MagicTower
             case GAME_STATE::GAME_MENU:
             case GAME_STATE::STORE_MENU:
             case GAME_STATE::JUMP_MENU:
+            case GAME_STATE::FLOOR_BROWSER:
                 return ;
             default:
                 break;
@@ -1149,6 +1325,7 @@ namespace MagicTower
             case GAME_STATE::GAME_MENU:
             case GAME_STATE::STORE_MENU:
             case GAME_STATE::JUMP_MENU:
+            case GAME_STATE::FLOOR_BROWSER:
                 return ;
             default:
                 break;
@@ -1191,6 +1368,7 @@ namespace MagicTower
             case GAME_STATE::GAME_MENU:
             case GAME_STATE::STORE_MENU:
             case GAME_STATE::JUMP_MENU:
+            case GAME_STATE::FLOOR_BROWSER:
                 return ;
             default:
                 break;
@@ -1231,6 +1409,7 @@ namespace MagicTower
             case GAME_STATE::GAME_MENU:
             case GAME_STATE::STORE_MENU:
             case GAME_STATE::JUMP_MENU:
+            case GAME_STATE::FLOOR_BROWSER:
                 return ;
             default:
                 break;
@@ -1255,6 +1434,7 @@ namespace MagicTower
             case GAME_STATE::GAME_MENU:
             case GAME_STATE::STORE_MENU:
             case GAME_STATE::JUMP_MENU:
+            case GAME_STATE::FLOOR_BROWSER:
                 return ;
             default:
                 break;
@@ -1455,6 +1635,8 @@ namespace MagicTower
         game_status->access_floor[ stair.floors ] = true;
         std::string floor_flag = std::string( "floors_" ) + std::to_string( stair.floors );
         game_status->script_flags[floor_flag] = 1;
+        //written later on I/O thread,stair hopping merged into one save
+        game_status->autosave.request();
 
         return true;
     }
@@ -1486,6 +1668,7 @@ namespace MagicTower
     static void set_jump_menu( GameStatus * game_status )
     {
         game_status->menu_items.clear();
+        game_status->slot_menu_ids.clear();
         game_status->menu_items.push_back({
             [](){ return std::string( "最上层" ); },
             [ game_status ](){
@@ -1530,6 +1713,12 @@ namespace MagicTower
                 game_status->hero.floors = begin_iter->first;
             }
         });
+        game_status->menu_items.push_back({
+            [](){ return std::string( "楼层浏览" ); },
+            [ game_status ](){
+                game_status->state = GAME_STATE::FLOOR_BROWSER;
+            }
+        });
         game_status->menu_items.push_back({
             [](){ return std::string( "确定跳跃" ); },
             [ game_status ](){
@@ -1567,6 +1756,7 @@ namespace MagicTower
     static void set_start_menu( GameStatus * game_status )
     {
         game_status->menu_items.clear();
+        game_status->slot_menu_ids.clear();
         game_status->menu_items.push_back({
             [](){ return std::string( "重新游戏" ); },
             [ game_status ](){
@@ -1575,10 +1765,7 @@ namespace MagicTower
         });
         game_status->menu_items.push_back({
             [](){ return std::string( "读取存档" ); },
-            [ game_status ](){
-                load_game( game_status , 1 );
-                game_status->state = GAME_STATE::NORMAL;
-            }
+            [ game_status ](){ set_slot_menu( game_status , false ); }
         });
         game_status->menu_items.push_back({
             [](){ return std::string( "退出游戏" ); },
@@ -1591,14 +1778,15 @@ namespace MagicTower
     static void set_game_menu( GameStatus * game_status )
     {
         game_status->menu_items.clear();
+        game_status->slot_menu_ids.clear();
 
         game_status->menu_items.push_back({
             [](){ return std::string( "保存存档" ); },
-            [ game_status ](){ save_game( game_status , 1 ); }
+            [ game_status ](){ set_slot_menu( game_status , true ); }
         });
         game_status->menu_items.push_back({
             [](){ return std::string( "读取存档" ); },
-            [ game_status ](){ load_game( game_status , 1 ); }
+            [ game_status ](){ set_slot_menu( game_status , false ); }
         });
         game_status->menu_items.push_back({
             [ game_status ](){
@@ -1637,6 +1825,15 @@ namespace MagicTower
             },
             [ game_status ](){ game_status->draw_path = !game_status->draw_path; }
         });
+        game_status->menu_items.push_back({
+            [ game_status ](){
+                if ( game_status->quicksave_flush )
+                    return std::string( "快速存档写入磁盘: 开" );
+                else
+                    return std::string( "快速存档写入磁盘: 关" );
+            },
+            [ game_status ](){ game_status->quicksave_flush = !game_status->quicksave_flush; }
+        });
         game_status->menu_items.push_back({
             [](){ return std::string( "关闭菜单" ); },
             [ game_status ](){ close_game_menu( game_status ); }
@@ -1646,6 +1843,7 @@ namespace MagicTower
     static void set_inventories_menu( GameStatus * game_status )
     {
         game_status->menu_items.clear();
+        game_status->slot_menu_ids.clear();
         for ( auto& item : game_status->inventories )
         {
             std::uint32_t item_id = item.first;
@@ -1676,6 +1874,7 @@ namespace MagicTower
     static void set_store_menu( GameStatus * game_status )
     {
         game_status->menu_items.clear();
+        game_status->slot_menu_ids.clear();
         for ( auto& store : game_status->stores )
         {
             if ( !store.second.usability )
@@ -1701,6 +1900,7 @@ namespace MagicTower
         game_status->focus_item_id = 0;
 
         game_status->menu_items.clear();
+        game_status->slot_menu_ids.clear();
         game_status->menu_items.push_back({
             [](){ return std::string( "返回上级菜单" ); },
             [ game_status ](){ set_store_menu( game_status ); }
@@ -1731,4 +1931,134 @@ namespace MagicTower
             [ game_status ](){ close_store_menu( game_status ); }
         });
     }
+
+    //store usability and floor jump access follow the script flags
+    static void sync_unlock_flags( GameStatus * game_status )
+    {
+        //store unlock flag
+        for ( auto& store : game_status->stores )
+        {
+            std::string flag_name = std::string( "store_" ) + std::to_string( store.first );
+            if ( game_status->script_flags.find( flag_name ) != game_status->script_flags.end() )
+            {
+                store.second.usability = true;
+            }
+            else
+            {
+                store.second.usability = false;
+            }
+            
+        }
+
+        //floor jump unlock flag
+        for ( std::uint32_t i = 0 ; i < game_status->game_map.map.size() ; i++ )
+        {
+            std::string floor_flag = std::string( "floors_" ) + std::to_string( i );
+            if ( game_status->script_flags.find( floor_flag ) != game_status->script_flags.end() )
+            {
+                game_status->access_floor[i] = true;
+            }
+            else
+            {
+                game_status->access_floor[i] = false;
+            }
+        }
+    }
+
+    static void make_save_directory( void )
+    {
+        Glib::RefPtr<Gio::File> save_dir = Gio::File::create_for_path( ResourcesManager::get_save_path() );
+        try
+        {
+            save_dir->make_directory_with_parents();
+        }
+        catch( const Glib::Error& e )
+        {
+            //if dir exists,do nothing.
+            g_log( __func__ , G_LOG_LEVEL_WARNING , "%s" , e.what().c_str() );
+        }
+    }
+
+    //slot label come from the save index,no archive opened
+    static std::string get_slot_label( GameStatus * game_status , std::size_t slot_id , const std::string& slot_name , bool archive_exists )
+    {
+        std::string label = slot_name + std::string( "  " );
+        const std::map<std::size_t,SaveSlotInfo>& slots = game_status->save_service.get_slots();
+        auto slot_iter = slots.find( slot_id );
+        if ( slot_iter == slots.end() )
+            return label + ( archive_exists ? std::string( "旧存档" ) : std::string( "空" ) );
+
+        const SaveSlotInfo& info = slot_iter->second;
+        std::string floor_name = info.floor_name.empty() ? std::to_string( info.floor_id ) + std::string( "层" ) : info.floor_name;
+        char play_time[32];
+        snprintf( play_time , sizeof( play_time ) , "%02" PRId64 ":%02" PRId64 ":%02" PRId64 ,
+            info.play_time/3600 , info.play_time/60%60 , info.play_time%60 );
+        std::string save_time;
+        Glib::DateTime date_time = Glib::DateTime::create_now_local( info.timestamp );
+        if ( date_time.gobj() != nullptr )
+            save_time = date_time.format( "%m-%d %H:%M" ).raw();
+        return label + floor_name + std::string( "  Lv" ) + std::to_string( info.level ) + std::string( "  " ) +
+            std::string( play_time ) + std::string( "  " ) + save_time;
+    }
+
+    static void set_slot_menu( GameStatus * game_status , bool save_mode )
+    {
+        game_status->focus_item_id = 0;
+
+        game_status->menu_items.clear();
+        game_status->slot_menu_ids.clear();
+        game_status->menu_items.push_back({
+            [](){ return std::string( "返回上级菜单" ); },
+            [ game_status ](){
+                game_status->focus_item_id = 0;
+                if ( game_status->state == GAME_STATE::START_MENU )
+                    set_start_menu( game_status );
+                else
+                    set_game_menu( game_status );
+            }
+        });
+        //preview of the focused slot,the back item has none
+        game_status->slot_menu_ids.push_back( 0 );
+        std::vector<std::pair<std::size_t,std::string>> menu_slots;
+        for ( std::size_t slot_id = 1 ; slot_id <= save_slot_count ; slot_id++ )
+        {
+            menu_slots.push_back({ slot_id , std::string( "存档" ) + std::to_string( slot_id ) });
+        }
+        //autosave slots are written by AutosaveScheduler only
+        if ( !save_mode )
+        {
+            for ( std::size_t i = 0 ; i < autosave_slot_count ; i++ )
+            {
+                menu_slots.push_back({ autosave_first_slot + i , std::string( "自动存档" ) + std::to_string( i + 1 ) });
+            }
+        }
+        for ( const auto& [ slot_id , slot_name ] : menu_slots )
+        {
+            //checked once per menu open,label is drawn every frame
+            bool archive_exists = Glib::file_test( ResourcesManager::get_save_path() + std::to_string( slot_id ) + std::string( ".db" ) ,
+                Glib::FILE_TEST_EXISTS );
+            game_status->slot_menu_ids.push_back( slot_id );
+            game_status->menu_items.push_back({
+                [ game_status , slot_id = slot_id , slot_name = slot_name , archive_exists ](){
+                    return get_slot_label( game_status , slot_id , slot_name , archive_exists );
+                },
+                [ game_status , slot_id = slot_id , save_mode ](){
+                    if ( save_mode )
+                    {
+                        save_game( game_status , slot_id );
+                        return ;
+                    }
+                    if ( game_status->state == GAME_STATE::START_MENU )
+                    {
+                        load_game( game_status , slot_id );
+                        game_status->state = GAME_STATE::NORMAL;
+                        return ;
+                    }
+                    load_game( game_status , slot_id );
+                    game_status->focus_item_id = 0;
+                    set_game_menu( game_status );
+                }
+            });
+        }
+    }
 }
@@ -56,6 +56,35 @@ namespace MagicTower
 
     void load_game( GameStatus * game_status , size_t save_id );
 
+    //write the oldest autosave slot on the I/O thread,false if the game can't be saved now
+    bool autosave_game( GameStatus * game_status );
+
+    void quick_save( GameStatus * game_status );
+
+    //older:one quicksave older than the last quickload,else the newest
+    void quick_load( GameStatus * game_status , bool older );
+
+    //record the changes made during one input event as one undo step.
+    //an event begin or end in menu is not recorded:jump menu preview move the hero,store and menu are not undoable
+    class ActionScope
+    {
+    public:
+        ActionScope( GameStatus * game_status );
+        ~ActionScope();
+
+        ActionScope( const ActionScope& rhs )=delete;
+        ActionScope( ActionScope&& rhs )=delete;
+        ActionScope& operator=( const ActionScope& rhs )=delete;
+        ActionScope& operator=( ActionScope&& rhs )=delete;
+    private:
+        GameStatus * game_status;
+        bool recording;
+    };
+
+    void undo_action( GameStatus * game_status );
+
+    void redo_action( GameStatus * game_status );
+
     void game_win( GameStatus * game_status );
 
     void game_lose( GameStatus * game_status );
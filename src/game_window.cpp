@@ -1,15 +1,24 @@
+#include <cmath>
+#include <cstdlib>
 #include <cstring>
 #include <cinttypes>
 
+#include <algorithm>
+#include <array>
+#include <bitset>
 #include <functional>
 #include <map>
 #include <memory>
+#include <optional>
+#include <set>
 #include <string>
+#include <tuple>
 #include <vector>
 
 #include <cairomm/cairomm.h>
 #include <gdkmm.h>
 #include <gdk/gdkkeysyms.h>
+#include <giomm/init.h>
 #include <glibmm.h>
 #include <glib/gstdio.h>
 #include <gtkmm/builder.h>
@@ -18,27 +27,128 @@
 #include <gtkmm/widget.h>
 #include <gtkmm/window.h>
 #include <pangomm.h>
+#include <pangomm/init.h>
 #include <sigc++/sigc++.h>
 
+#include "band_rasterizer.h"
 #include "env_var.h"
 #include "game_event.h"
 #include "game_window.h"
 #include "resources.h"
+#include "sprite_cache.h"
+#include "metrics.h"
+#include "text_cache.h"
+#include "thumbnail_cache.h"
+#include "tile_cache.h"
+#include "vision.h"
 
 namespace MagicTower
 {
+    //floor layer is split into layer_chunk_size*layer_chunk_size grid chunks,
+    //only the chunks in viewport are rasterized,so draw cost not grow with floor size
+    constexpr std::uint32_t layer_chunk_size = 16;
+    //pixel bytes of rasterized chunks kept across all floors,least recently drawn chunk evicted first.
+    //a chunk cost grow with the square of pixel size and scale,so bound by bytes rather than chunk count.
+    //chunks drawn in current frame are always kept
+    constexpr std::size_t layer_chunk_budget = 128*1024*1024;
+    //new chunks of a frame reach this grid count are painted by band rasterizer in parallel
+    constexpr std::size_t parallel_rasterize_grids = 1024;
+    //grid rows of a band
+    constexpr std::uint32_t layer_band_rows = 4;
+    //camera follow speed,the remaining distance decay by e every 1/camera_follow_rate second
+    constexpr double camera_follow_rate = 12.0;
+    //animation frame duration in microsecond,all animated sprites step together
+    constexpr std::int64_t animation_frame_interval = 250000;
+
+    struct LayerChunk
+    {
+        //grid tile + monster damage text,updated per dirty grid
+        Cairo::RefPtr<Cairo::ImageSurface> composed;
+        //the grids already rasterized,compare with floor content to find dirty grid
+        std::vector<TowerGrid> content;
+        //hero level,life,attack,defense:the input of monster damage text
+        std::array<std::uint32_t,4> damage_key;
+        //per grid:1 if the grid image is animated,redraw when animation frame change
+        std::vector<std::uint8_t> animated;
+        std::size_t animated_count;
+        std::uint64_t animation_frame;
+        //frame number of last draw
+        std::uint64_t last_used;
+    };
+
+    //rasterized floor cache,chunk key:( chunk_y << 32 ) | chunk_x
+    struct FloorLayer
+    {
+        std::map<std::uint64_t,LayerChunk> chunks;
+        std::uint32_t length;
+        std::uint32_t width;
+        std::uint32_t default_floorid;
+        std::uint32_t pixel_size;
+        std::uint64_t sprite_generation;
+    };
+
+    //side panel:floor name,9 hero fields,key help
+    constexpr std::size_t info_line_count = 11;
+    constexpr std::size_t info_value_count = 9;
+
+    //side panel cache,a line is redrawn only when its field changed
+    struct InfoPanel
+    {
+        Cairo::RefPtr<Cairo::ImageSurface> surface;
+        std::string floor_name;
+        //level,life,attack,defense,gold,experience,yellow_key,blue_key,red_key
+        std::array<std::int64_t,info_value_count> values = {};
+        //bit i:line i need redraw
+        std::bitset<info_line_count> dirty;
+    };
+
+    //frames rendered per floor in offscreen mode
+    constexpr std::size_t offscreen_frames = 16;
+
     class GameWindowImp
     {
     public:
+        using DrawHandler = bool ( GameWindowImp::* )( const Cairo::RefPtr<Cairo::Context>& );
+
         GameWindowImp():
+            GameWindowImp( std::nullopt )
+        {
+        }
+
+        //offscreen_size:( width , height ) of tower area + info area,
+        //render through the same draw handlers without display and window
+        GameWindowImp( std::optional<std::pair<int,int>> offscreen_size ):
+            startup_time( g_get_monotonic_time() ),
             game_status( new GameStatus() ),
-            main_loop(),
+            main_loop( offscreen_size.has_value() ? nullptr : new Gtk::Main() ),
             font_desc( "Microsoft YaHei 16" ),
+            text_cache(),
+            metrics(),
+            metrics_layout(),
+            sprite_cache(),
+            tile_cache(),
+            band_rasterizer(),
+            vision_mask(),
+            thumbnail_cache(),
             findpath_connection(),
-            draw_connection()
+            draw_connection(),
+            window( nullptr ),
+            game_area( nullptr ),
+            info_area( nullptr )
         {
             scriptengines_register_eventfunc( game_status );
 
+            //decoded sprites are uploaded on main thread,redraw to replace placeholder
+            this->sprite_cache.signal_sprites_ready().connect( sigc::mem_fun( *this , &GameWindowImp::sprites_ready_handler ) );
+            this->sprite_cache.set_pixel_size( this->pixel_size );
+            this->thumbnail_cache.signal_thumbnails_ready().connect( sigc::mem_fun( *this , &GameWindowImp::queue_redraw ) );
+
+            if ( offscreen_size.has_value() )
+            {
+                this->initial_offscreen( offscreen_size.value().first , offscreen_size.value().second );
+                return ;
+            }
+
             std::vector<std::string> music_list = ResourcesManager::get_musics_uri();
             this->game_status->music.set_playmode( PLAY_MODE::RANDOM_PLAYING );
             this->game_status->music.set_playlist( music_list );
@@ -53,28 +163,34 @@ namespace MagicTower
             int grid_height = rectangle.get_height()/this->max_grid_y;
             if ( grid_width > grid_height )
                 grid_width = grid_height;
-            this->pixel_size = grid_width/32*32;
+            //initial window size,pixel size follow the tower area allocation after resize
+            int default_pixel_size = std::max( grid_width/32*32 , 32 );
 
             auto builder_refptr = Gtk::Builder::create_from_file( "./resources/UI/magictower.ui" );
 
-            int tower_width = ( this->max_grid_x )*this->pixel_size;
-            int info_width = ( this->max_grid_x/3 )*this->pixel_size;
-            int window_height = ( this->max_grid_y )*this->pixel_size;
+            //minimum size:32 pixel grid
+            int tower_width = ( this->max_grid_x )*32;
+            int info_width = ( this->max_grid_x/3 )*32;
+            int window_height = ( this->max_grid_y )*32;
 
             builder_refptr->get_widget( "info_area" , this->info_area );
-            this->info_area->signal_draw().connect( sigc::mem_fun( *this , &GameWindowImp::draw_info ) );
+            this->info_area->signal_draw().connect( this->timed_draw( "draw_info" , &GameWindowImp::draw_info ) );
             this->info_area->set_size_request( info_width , window_height );
 
             builder_refptr->get_widget( "tower_area" , this->game_area );
             this->game_area->add_events( Gdk::EventMask::BUTTON_PRESS_MASK );
-            this->game_area->signal_draw().connect( sigc::mem_fun( *this , &GameWindowImp::draw_maps ) );
-            this->game_area->signal_draw().connect( sigc::mem_fun( *this , &GameWindowImp::draw_path_line ) );
-            this->game_area->signal_draw().connect( sigc::mem_fun( *this , &GameWindowImp::draw_hero ) );
-            this->game_area->signal_draw().connect( sigc::mem_fun( *this , &GameWindowImp::draw_tips ) );
-            this->game_area->signal_draw().connect( sigc::mem_fun( *this , &GameWindowImp::draw_detail ) );
-            this->game_area->signal_draw().connect( sigc::mem_fun( *this , &GameWindowImp::draw_menu ) );
-            this->game_area->signal_draw().connect( sigc::mem_fun( *this , &GameWindowImp::draw_message ) );
+            for ( auto& [ series , handler ] : this->get_tower_draw_handlers() )
+            {
+                this->game_area->signal_draw().connect( this->timed_draw( series , handler ) );
+            }
             this->game_area->signal_button_press_event().connect( sigc::mem_fun( *this , &GameWindowImp::button_press_handler ) );
+            this->game_area->signal_size_allocate().connect( sigc::mem_fun( *this , &GameWindowImp::size_allocate_handler ) );
+            //window moved to a monitor of other scale factor
+            this->game_area->property_scale_factor().signal_changed().connect( [ this ]()
+            {
+                Gtk::Allocation allocation = this->get_tower_allocation();
+                this->size_allocate_handler( allocation );
+            });
             this->game_area->set_size_request( tower_width , window_height );
 
             builder_refptr->get_widget( "game_window" , this->window );
@@ -83,153 +199,476 @@ namespace MagicTower
             //if after is true,Key Up Space Down Return Left Right.... key_press_handler can't receive.
             this->window->signal_key_press_event().connect( sigc::mem_fun( *this , &GameWindowImp::key_press_handler ) , false );
             this->window->signal_scroll_event().connect( sigc::mem_fun( *this , &GameWindowImp::scroll_signal_handler ) );
-            this->window->set_size_request( tower_width + info_width , window_height );
+            this->window->set_default_size( ( this->max_grid_x + this->max_grid_x/3 )*default_pixel_size , this->max_grid_y*default_pixel_size );
             this->window->show_all();
 
             this->layout = window->create_pango_layout( "字符串" );
             this->layout->set_font_description( this->font_desc );
+            this->text_cache.set_context( this->layout->get_context() );
 
-            auto surface = Cairo::ImageSurface::create( Cairo::Format::FORMAT_ARGB32 , this->pixel_size , this->pixel_size );
-            auto cairo_context = Cairo::Context::create( surface );
-            cairo_context->save();
-            cairo_context->set_source_rgb( 0 , 0 , 0 );
-            cairo_context->paint();
-            cairo_context->restore();
-            auto backup_image = Gdk::Pixbuf::create( surface , 0  , 0 , this->pixel_size , this->pixel_size );
-            this->image_resource[ResourcesManager::get_image( "backup" , 1 )] = backup_image;
+            //current floor first,then the rest of image directory in background
+            this->prefetch_floors( this->game_status->hero.floors );
+            this->sprite_cache.prefetch_all();
+            g_log( __func__ , G_LOG_LEVEL_MESSAGE , "window ready after %.3f ms" , ( g_get_monotonic_time() - this->startup_time )/1000.0 );
+        }
 
-            std::vector<std::string> image_paths = ResourcesManager::get_images();
-            for ( auto& image_path : image_paths )
+        ~GameWindowImp()
+        {
+            //MAGICTOWER_METRICS_CSV=path:dump the metrics window on exit
+            std::string csv_path = Glib::getenv( "MAGICTOWER_METRICS_CSV" );
+            if ( !csv_path.empty() )
             {
-                Glib::RefPtr<Gdk::Pixbuf> pixbuf;
                 try
                 {
-                    pixbuf = Gdk::Pixbuf::create_from_file( image_path , this->pixel_size , this->pixel_size );
-                }
-                catch ( const Gdk::PixbufError& e )
-                {
-                    g_log( __func__ , G_LOG_LEVEL_WARNING , "from \'%s\' create gdkpixbuf failure,error code:%d,fallback to backup image." , image_path.c_str() , e.code() );
-                    pixbuf = backup_image;
+                    Glib::file_set_contents( csv_path , this->metrics.to_csv() );
                 }
                 catch ( const Glib::FileError& e )
                 {
-                    g_log( __func__ , G_LOG_LEVEL_WARNING , "open \'%s\' failure,error code:%d,fallback to backup image." , image_path.c_str() , e.code() );
-                    pixbuf = backup_image;
+                    g_log( __func__ , G_LOG_LEVEL_WARNING , "metrics dump failed:%s" , e.what().c_str() );
                 }
-                this->image_resource[image_path] = pixbuf;
             }
-            this->info_frame = info_background_image_factory( this->max_grid_y/2 , this->max_grid_x );
-        }
-
-        ~GameWindowImp()
-        {
             delete this->game_status;
             delete this->window;
         }
 
         void run()
         {
-            this->main_loop.run( std::ref( *this->window ) );
+            this->main_loop->run( std::ref( *this->window ) );
         }
 
-        std::pair<std::uint8_t,std::uint8_t> get_draw_offsets( void )
+        //render every floor offscreen,write floor_<id>.png,render_times.csv and metrics.csv to output_dir
+        int render_offscreen( const std::string& output_dir )
         {
-            std::uint32_t floor_length = this->game_status->game_map.map[ this->game_status->hero.floors ].length;
-            std::uint32_t floor_width = this->game_status->game_map.map[ this->game_status->hero.floors ].width;
-            std::uint32_t offset_x = 0;
-            std::uint32_t offset_y = 0;
-            if ( floor_length > this->max_grid_x )
+            if ( g_mkdir_with_parents( output_dir.c_str() , 0755 ) != 0 )
             {
-                if ( this->game_status->hero.x >= this->max_grid_x/2 )
-                {
-                    if ( ( this->game_status->hero.x + this->max_grid_x/2 ) >= floor_length )
-                    {
-                        offset_x = floor_length - this->max_grid_x;
-                    }
-                    else
-                    {
-                        offset_x = this->game_status->hero.x - this->max_grid_x/2;
-                    }
-                }
+                g_log( __func__ , G_LOG_LEVEL_WARNING , "can't create directory:%s" , output_dir.c_str() );
+                return EXIT_FAILURE;
             }
-            if ( floor_width > this->max_grid_y )
+            Glib::RefPtr<Glib::MainContext> main_context = Glib::MainContext::get_default();
+            Gtk::Allocation tower_allocation = this->get_tower_allocation();
+            Gtk::Allocation info_allocation = this->get_info_allocation();
+            auto surface = Cairo::ImageSurface::create( Cairo::Format::FORMAT_ARGB32 ,
+                tower_allocation.get_width() + info_allocation.get_width() , tower_allocation.get_height() );
+
+            std::string csv( "floor,cold_ms,warm_p50_ms,warm_p99_ms\n" );
+            Hero& hero = this->game_status->hero;
+            for ( auto& [ floor_id , floor ] : this->game_status->game_map.map )
             {
-                if ( this->game_status->hero.y >= this->max_grid_y/2 )
+                hero.floors = floor_id;
+                if ( floor.teleport_point.has_value() )
                 {
-                    if ( ( this->game_status->hero.y + this->max_grid_y/2 ) >= floor_width )
-                    {
-                        offset_y = floor_width - this->max_grid_y;
-                    }
+                    hero.x = floor.teleport_point.value().x;
+                    hero.y = floor.teleport_point.value().y;
+                }
+                //render the decoded sprites,not the placeholder
+                this->prefetch_floors( floor_id );
+                while ( this->sprite_cache.has_pending() )
+                    main_context->iteration( true );
+
+                //first frame rasterize the layer chunks,the rest hit the caches
+                double cold_time = 0;
+                SampleRing warm_times( offscreen_frames );
+                for ( std::size_t frame = 0 ; frame < offscreen_frames ; frame++ )
+                {
+                    auto cairo_context = Cairo::Context::create( surface );
+                    cairo_context->set_operator( Cairo::Operator::OPERATOR_CLEAR );
+                    cairo_context->paint();
+                    cairo_context->set_operator( Cairo::Operator::OPERATOR_OVER );
+                    std::int64_t begin_time = g_get_monotonic_time();
+                    this->render_frame( cairo_context );
+                    double elapsed = ( g_get_monotonic_time() - begin_time )/1000.0;
+                    if ( frame == 0 )
+                        cold_time = elapsed;
                     else
-                    {
-                        offset_y = this->game_status->hero.y - this->max_grid_y/2;
-                    }
+                        warm_times.push( elapsed );
                 }
+                surface->flush();
+                surface->write_to_png( Glib::build_filename( output_dir , "floor_" + std::to_string( floor_id ) + ".png" ) );
+
+                char line[128];
+                g_snprintf( line , sizeof( line ) , "%" PRIu32 ",%.3f,%.3f,%.3f\n" , floor_id , cold_time ,
+                    warm_times.percentile( 50 ) , warm_times.percentile( 99 ) );
+                csv += line;
             }
 
-            return { offset_x , offset_y };
+            try
+            {
+                Glib::file_set_contents( Glib::build_filename( output_dir , "render_times.csv" ) , csv );
+                Glib::file_set_contents( Glib::build_filename( output_dir , "metrics.csv" ) , this->metrics.to_csv() );
+            }
+            catch ( const Glib::FileError& e )
+            {
+                g_log( __func__ , G_LOG_LEVEL_WARNING , "render result write failed:%s" , e.what().c_str() );
+                return EXIT_FAILURE;
+            }
+            g_log( __func__ , G_LOG_LEVEL_MESSAGE , "%zu floors rendered after %.3f ms" , this->game_status->game_map.map.size() ,
+                ( g_get_monotonic_time() - this->startup_time )/1000.0 );
+            return EXIT_SUCCESS;
         }
 
-        /*  coordinate system (y,x):
-            (0,0),(0,1),(0,2)
-            (1,0),(1,1),(1,2)
-            (2,0),(2,1),(2,2)
-        */
-        bool is_visible( std::uint32_t x , std::uint32_t y )
+        //tower area draw signal handlers,in emission order
+        std::vector<std::pair<const char *,DrawHandler>> get_tower_draw_handlers( void )
         {
-            auto& field_vision = this->game_status->game_map.map[ this->game_status->hero.floors ].field_vision;
-            if ( !field_vision.has_value() )
+            return {
+                { "draw_maps" , &GameWindowImp::draw_maps } ,
+                { "draw_path_line" , &GameWindowImp::draw_path_line } ,
+                { "draw_hero" , &GameWindowImp::draw_hero } ,
+                { "draw_minimap" , &GameWindowImp::draw_minimap } ,
+                { "draw_floor_browser" , &GameWindowImp::draw_floor_browser } ,
+                { "draw_tips" , &GameWindowImp::draw_tips } ,
+                { "draw_detail" , &GameWindowImp::draw_detail } ,
+                { "draw_menu" , &GameWindowImp::draw_menu } ,
+                { "draw_message" , &GameWindowImp::draw_message } ,
+                { "draw_metrics" , &GameWindowImp::draw_metrics }
+            };
+        }
+
+        //one frame of tower area( left ) and info area( right ),as the widgets emit draw signal
+        void render_frame( const Cairo::RefPtr<Cairo::Context>& cairo_context )
+        {
+            Gtk::Allocation tower_allocation = this->get_tower_allocation();
+            Gtk::Allocation info_allocation = this->get_info_allocation();
+
+            cairo_context->save();
+            cairo_context->rectangle( 0 , 0 , tower_allocation.get_width() , tower_allocation.get_height() );
+            cairo_context->clip();
+            for ( auto& [ series , handler ] : this->get_tower_draw_handlers() )
             {
-                return true;
+                ScopedTimer timer( this->metrics , series );
+                //true stop the emission
+                if ( ( this->*handler )( cairo_context ) )
+                    break;
             }
-            auto offsets = this->get_draw_offsets();
-            std::uint32_t origin_x = this->game_status->hero.x - offsets.first;
-            std::uint32_t origin_y = this->game_status->hero.y - offsets.second;
+            cairo_context->restore();
 
-            if ( std::abs( (std::int64_t)origin_x - (std::int64_t)x ) > field_vision.value().x )
+            cairo_context->save();
+            cairo_context->translate( tower_allocation.get_width() , 0 );
+            cairo_context->rectangle( 0 , 0 , info_allocation.get_width() , info_allocation.get_height() );
+            cairo_context->clip();
             {
-                return false;
+                ScopedTimer timer( this->metrics , "draw_info" );
+                this->draw_info( cairo_context );
+            }
+            cairo_context->restore();
+        }
+
+        Gtk::Allocation get_tower_allocation( void )
+        {
+            if ( this->game_area == nullptr )
+                return Gtk::Allocation( 0 , 0 , this->offscreen_tower_width , this->offscreen_height );
+            return this->game_area->get_allocation();
+        }
+
+        Gtk::Allocation get_info_allocation( void )
+        {
+            if ( this->info_area == nullptr )
+                return Gtk::Allocation( 0 , 0 , this->offscreen_info_width , this->offscreen_height );
+            return this->info_area->get_allocation();
+        }
+
+        //wrap draw handler,record the elapsed time to metrics series
+        sigc::slot<bool,const Cairo::RefPtr<Cairo::Context>&> timed_draw( const char * series , DrawHandler handler )
+        {
+            return [ this , series , handler ]( const Cairo::RefPtr<Cairo::Context>& cairo_context ) -> bool
+            {
+                ScopedTimer timer( this->metrics , series );
+                return ( this->*handler )( cairo_context );
+            };
+        }
+
+        //camera target:hero at viewport center,clamp to floor border.
+        //the floor smaller than viewport is centered
+        std::pair<double,double> get_camera_target( void )
+        {
+            Gtk::Allocation allocation = this->get_tower_allocation();
+            TowerFloor& floor = this->game_status->game_map.map[ this->game_status->hero.floors ];
+            Hero& hero = this->game_status->hero;
+            auto clamp_axis = []( double hero_center , double floor_size , double view_size ) -> double
+            {
+                if ( floor_size <= view_size )
+                    return ( floor_size - view_size )/2;
+                return std::clamp( hero_center - view_size/2 , 0.0 , floor_size - view_size );
+            };
+            return {
+                clamp_axis( ( hero.x + 0.5 )*this->pixel_size , static_cast<double>( floor.length )*this->pixel_size , allocation.get_width() ) ,
+                clamp_axis( ( hero.y + 0.5 )*this->pixel_size , static_cast<double>( floor.width )*this->pixel_size , allocation.get_height() )
+            };
+        }
+
+        //camera position in pixel,rounded to avoid blurry blit
+        std::pair<double,double> get_camera( void )
+        {
+            return { std::round( this->camera_x ) , std::round( this->camera_y ) };
+        }
+
+        //widget position -> map coordinate,may be outside the floor
+        TowerGridLocation get_grid_location( double x , double y )
+        {
+            auto camera = this->get_camera();
+            return {
+                static_cast<std::int64_t>( std::floor( ( x + camera.first )/this->pixel_size ) ) ,
+                static_cast<std::int64_t>( std::floor( ( y + camera.second )/this->pixel_size ) )
+            };
+        }
+
+        //jump to target after floor or grid size change,else follow the hero smoothly
+        void update_camera( void )
+        {
+            auto target = this->get_camera_target();
+            if ( ( this->camera_floor != this->game_status->hero.floors ) || ( this->camera_pixel_size != this->pixel_size ) )
+            {
+                this->camera_floor = this->game_status->hero.floors;
+                this->camera_pixel_size = this->pixel_size;
+                this->camera_x = target.first;
+                this->camera_y = target.second;
+                return ;
+            }
+            //offscreen frame has no frame clock,stand still at target
+            if ( this->game_area == nullptr )
+            {
+                this->camera_x = target.first;
+                this->camera_y = target.second;
+                return ;
+            }
+            if ( ( target.first != this->camera_x || target.second != this->camera_y ) && !this->camera_ticking )
+            {
+                this->camera_ticking = true;
+                this->camera_frame_time = 0;
+                this->game_area->add_tick_callback( sigc::mem_fun( *this , &GameWindowImp::camera_tick ) );
             }
+        }
 
-            if ( std::abs( (std::int64_t)origin_y - (std::int64_t)y ) > field_vision.value().y )
+        bool camera_tick( const Glib::RefPtr<Gdk::FrameClock>& frame_clock )
+        {
+            std::int64_t frame_time = frame_clock->get_frame_time();
+            double elapsed = 1.0/60;
+            if ( this->camera_frame_time != 0 )
+                elapsed = std::clamp( ( frame_time - this->camera_frame_time )/1000000.0 , 0.0 , 0.1 );
+            this->camera_frame_time = frame_time;
+
+            auto target = this->get_camera_target();
+            double factor = 1 - std::exp( -elapsed*camera_follow_rate );
+            this->camera_x += ( target.first - this->camera_x )*factor;
+            this->camera_y += ( target.second - this->camera_y )*factor;
+            this->game_area->queue_draw();
+            if ( std::abs( target.first - this->camera_x ) < 0.5 && std::abs( target.second - this->camera_y ) < 0.5 )
             {
+                this->camera_x = target.first;
+                this->camera_y = target.second;
+                this->camera_ticking = false;
                 return false;
             }
+            return true;
+        }
 
+        //shared animation clock,follow frame clock time instead of logic tick or redraw count
+        bool animation_tick( const Glib::RefPtr<Gdk::FrameClock>& frame_clock )
+        {
+            std::uint64_t frame = frame_clock->get_frame_time()/animation_frame_interval;
+            if ( frame != this->animation_frame )
+            {
+                this->animation_frame = frame;
+                this->game_area->queue_draw();
+            }
+            if ( !this->animation_visible )
+            {
+                this->animation_ticking = false;
+                return false;
+            }
             return true;
         }
 
+        /*  coordinate system (y,x):
+            (0,0),(0,1),(0,2)
+            (1,0),(1,1),(1,2)
+            (2,0),(2,1),(2,2)
+            x,y is map coordinate,not screen position
+        */
+        bool is_visible( std::int64_t x , std::int64_t y )
+        {
+            return this->vision_mask.is_visible( x , y );
+        }
+
+        //recompute vision mask only after hero moved or floor changed
+        void update_vision( void )
+        {
+            this->vision_mask.update( this->game_status->game_map , this->game_status->hero.floors ,
+                this->game_status->hero.x , this->game_status->hero.y );
+        }
+
     protected:
-        Glib::RefPtr<Gdk::Pixbuf> info_background_image_factory( size_t width , size_t height )
+        //width,height:logical size of info area,tiled by floor image,the last row and column are cut
+        Cairo::RefPtr<Cairo::ImageSurface> info_background_image_factory( int width , int height )
         {
-            Glib::RefPtr<Gdk::Pixbuf> info_frame = Gdk::Pixbuf::create( Gdk::Colorspace::COLORSPACE_RGB , TRUE , 8 , width*this->pixel_size , height*this->pixel_size );
-            std::string image_path = ResourcesManager::get_image( "floor" , 11 );
-            Glib::RefPtr<Gdk::Pixbuf> bg_pixbuf;
-            try
+            auto info_frame = this->create_scaled_surface( width , height );
+            auto cairo_context = Cairo::Context::create( info_frame );
+            std::uint32_t grid_columns = ( width + this->pixel_size - 1 )/this->pixel_size;
+            std::uint32_t grid_rows = ( height + this->pixel_size - 1 )/this->pixel_size;
+            for ( std::uint32_t y = 0 ; y < grid_rows ; y++ )
             {
-                bg_pixbuf = this->image_resource.at(image_path);
+                for ( std::uint32_t x = 0 ; x < grid_columns ; x++ )
+                {
+                    this->draw_grid_image( cairo_context , x , y , "floor" , 11 );
+                }
             }
-            catch ( const std::out_of_range& e)
+
+            return info_frame;
+        }
+
+        //queue the sprites used by the floor and the adjacent floors
+        void prefetch_floors( std::uint32_t floor_id )
+        {
+            auto& tower_map = this->game_status->game_map.map;
+            auto current_iter = tower_map.find( floor_id );
+            if ( current_iter == tower_map.end() )
+                return ;
+            this->prefetched_floor = floor_id;
+
+            std::vector<decltype( current_iter )> floor_iters = { current_iter };
+            if ( std::next( current_iter ) != tower_map.end() )
+                floor_iters.push_back( std::next( current_iter ) );
+            if ( current_iter != tower_map.begin() )
+                floor_iters.push_back( std::prev( current_iter ) );
+
+            for ( auto floor_iter : floor_iters )
             {
-                g_log( __func__ , G_LOG_LEVEL_WARNING , "image resource \'%s\' not found,fallback to backup image." , image_path.c_str() );
-                bg_pixbuf = this->image_resource[ResourcesManager::get_image( "backup" , 1 )];
+                for ( const std::string& image : this->get_floor_images( floor_iter->first , floor_iter->second ) )
+                {
+                    this->sprite_cache.prefetch( image );
+                }
             }
+        }
 
-            for ( size_t y = 0 ; y < height ; y++ )
+        //distinct images used by the floor,the grids are walked again only after the floor changed
+        const std::set<std::string>& get_floor_images( std::uint32_t floor_id , const TowerFloor& floor )
+        {
+            //generation start from 1,new entry always build
+            auto& [ generation , images ] = this->floor_images[ floor_id ];
+            if ( generation == floor.generation )
+                return images;
+            generation = floor.generation;
+            images.clear();
+
+            //a floor use a few distinct grids,resolve the image name once per grid kind
+            std::set<std::pair<GRID_TYPE,std::uint32_t>> grids;
+            for ( const TowerGrid& grid : floor.content )
             {
-                for ( size_t x = 0 ; x < width ; x++ )
+                grids.insert( { grid.type , grid.id } );
+            }
+            images.insert( ResourcesManager::get_image( "floor" , floor.default_floorid ) );
+            for ( auto& [ type , id ] : grids )
+            {
+                switch( type )
                 {
-                    bg_pixbuf->composite( info_frame , x*this->pixel_size , y*this->pixel_size , this->pixel_size , this->pixel_size ,
-                    x*this->pixel_size , y*this->pixel_size , 1.0 , 1.0 , Gdk::InterpType::INTERP_BILINEAR , 255 );
+                    case GRID_TYPE::BOUNDARY:
+                        images.insert( ResourcesManager::get_image( "boundary" , id ) );
+                        break;
+                    case GRID_TYPE::FLOOR:
+                        images.insert( ResourcesManager::get_image( "floor" , id ) );
+                        break;
+                    case GRID_TYPE::WALL:
+                        images.insert( ResourcesManager::get_image( "wall" , id ) );
+                        break;
+                    case GRID_TYPE::STAIRS:
+                        images.insert( ResourcesManager::get_image( "stairs" , this->game_status->stairs[ id ].type ) );
+                        break;
+                    case GRID_TYPE::DOOR:
+                        images.insert( ResourcesManager::get_image( "door" , id ) );
+                        break;
+                    case GRID_TYPE::NPC:
+                        images.insert( ResourcesManager::get_image( "npc" , id ) );
+                        break;
+                    case GRID_TYPE::MONSTER:
+                        images.insert( ResourcesManager::get_image( "monster" , id ) );
+                        break;
+                    case GRID_TYPE::ITEM:
+                        images.insert( ResourcesManager::get_image( "item" , id ) );
+                        break;
+                    default :
+                        break;
                 }
             }
+            return images;
+        }
 
-            return info_frame;
+        void sprites_ready_handler( void )
+        {
+            this->adopt_sprite_size();
+            this->queue_redraw();
+            if ( !this->startup_decode_logged && !this->sprite_cache.has_pending() )
+            {
+                this->startup_decode_logged = true;
+                g_log( __func__ , G_LOG_LEVEL_MESSAGE , "%zu sprites ready after %.3f ms" , this->sprite_cache.get_decoded_count() ,
+                    ( g_get_monotonic_time() - this->startup_time )/1000.0 );
+            }
+        }
+
+        //grid size follow the tower area and scale factor,rescale all sprites in background when it change.
+        //keep drawing the old size until the sprite cache swap in the rescaled sprites
+        void size_allocate_handler( Gtk::Allocation& allocation )
+        {
+            int grid_size = std::min( allocation.get_width()/this->max_grid_x , allocation.get_height()/this->max_grid_y );
+            std::uint32_t new_pixel_size = std::max( grid_size/32*32 , 32 );
+            std::uint32_t new_scale = ( this->game_area != nullptr ) ? std::max( this->game_area->get_scale_factor() , 1 ) : 1;
+            if ( ( new_pixel_size == this->requested_pixel_size ) && ( new_scale == this->requested_scale ) )
+                return ;
+
+            this->requested_pixel_size = new_pixel_size;
+            this->requested_scale = new_scale;
+            this->sprite_cache.set_pixel_size( new_pixel_size , new_scale );
+            this->prefetch_floors( this->game_status->hero.floors );
+            this->sprite_cache.prefetch_all();
+            this->adopt_sprite_size();
+        }
+
+        //follow the size of displayed sprites
+        void adopt_sprite_size( void )
+        {
+            if ( ( this->pixel_size == this->sprite_cache.get_pixel_size() ) && ( this->scale_factor == this->sprite_cache.get_scale() ) )
+                return ;
+            this->pixel_size = this->sprite_cache.get_pixel_size();
+            this->scale_factor = this->sprite_cache.get_scale();
+            this->text_cache.set_scale( this->scale_factor );
+            this->queue_redraw();
+        }
+
+        //width,height:logical size,surface has scale_factor times pixel
+        Cairo::RefPtr<Cairo::ImageSurface> create_scaled_surface( int width , int height )
+        {
+            auto surface = Cairo::ImageSurface::create( Cairo::Format::FORMAT_ARGB32 , width*this->scale_factor , height*this->scale_factor );
+            cairo_surface_set_device_scale( surface->cobj() , this->scale_factor , this->scale_factor );
+            return surface;
+        }
+
+        //no widget in offscreen mode
+        void queue_redraw( void )
+        {
+            if ( this->info_area != nullptr )
+                this->info_area->queue_draw();
+            if ( this->game_area != nullptr )
+                this->game_area->queue_draw();
+        }
+
+        void initial_offscreen( int width , int height )
+        {
+            //same proportion as the default window:tower area max_grid_x grids,info area max_grid_x/3 grids
+            this->offscreen_tower_width = width*this->max_grid_x/( this->max_grid_x + this->max_grid_x/3 );
+            this->offscreen_info_width = width - this->offscreen_tower_width;
+            this->offscreen_height = height;
+
+            auto surface = Cairo::ImageSurface::create( Cairo::Format::FORMAT_ARGB32 , 1 , 1 );
+            this->layout = Pango::Layout::create( Cairo::Context::create( surface ) );
+            this->layout->set_font_description( this->font_desc );
+            this->text_cache.set_context( this->layout->get_context() );
+
+            Gtk::Allocation allocation = this->get_tower_allocation();
+            this->size_allocate_handler( allocation );
+            this->prefetch_floors( this->game_status->hero.floors );
         }
 
         Gdk::Rectangle get_menu_ractangle( void )
         {
-            Gtk::Allocation allocation = this->game_area->get_allocation();
+            Gtk::Allocation allocation = this->get_tower_allocation();
             const int widget_width = allocation.get_width();
             const int widget_height = allocation.get_height();
             const int box_start_x = widget_height/6;
@@ -244,7 +683,7 @@ namespace MagicTower
         {
             if ( this->game_status->state == GAME_STATE::GAME_END )
             {
-                this->main_loop.quit();
+                this->main_loop->quit();
             }
             this->info_area->queue_draw();
             this->game_area->queue_draw();
@@ -310,7 +749,14 @@ namespace MagicTower
             }
 
             game_status->path.pop_back();
-            if ( !move_hero( game_status , { game_status->hero.floors , (std::uint32_t)goal.x , (std::uint32_t)goal.y } ) )
+            //walking steps are merged by the journal
+            ActionScope action( game_status );
+            bool moved;
+            {
+                ScopedTimer timer( this->metrics , "move_hero" );
+                moved = move_hero( game_status , { game_status->hero.floors , (std::uint32_t)goal.x , (std::uint32_t)goal.y } );
+            }
+            if ( !moved )
             {
                 if ( game_status->state == GAME_STATE::FIND_PATH )
                     game_status->state = GAME_STATE::NORMAL;
@@ -322,34 +768,16 @@ namespace MagicTower
         //GDK coordinate origin : Top left corner,left -> right x add,up -> down y add.
         void draw_grid_image( const Cairo::RefPtr<Cairo::Context> & cairo_context , std::uint32_t x , std::uint32_t y , std::string image_type , std::uint32_t image_id )
         {
-            std::string image_file_name = ResourcesManager::get_image( image_type , image_id );
-            Glib::RefPtr<Gdk::Pixbuf> element;
-            try
-            {
-                element = this->image_resource.at(image_file_name);
-            }
-            catch ( const std::out_of_range& e)
-            {
-                g_log( __func__ , G_LOG_LEVEL_WARNING , "image resource \'%s\' not found,fallback to backup image." , image_file_name.c_str() );
-                element = this->image_resource[ResourcesManager::get_image( "backup" , 1 )];
-            }
-            Gdk::Cairo::set_source_pixbuf( cairo_context , element , x*this->pixel_size , y*this->pixel_size );
-            cairo_context->paint();
+            //not decoded image get a placeholder,will be redraw when sprite cache generation change
+            auto element = this->sprite_cache.get_sprite( ResourcesManager::get_image( image_type , image_id ) );
+            cairo_context->set_source( element , x*this->pixel_size , y*this->pixel_size );
+            cairo_context->rectangle( x*this->pixel_size , y*this->pixel_size , this->pixel_size , this->pixel_size );
+            cairo_context->fill();
         }
 
         void draw_damage( const Cairo::RefPtr<Cairo::Context> & cairo_context , std::uint32_t x , std::uint32_t y , std::uint32_t monster_id )
         {
-            //todo:cache damage list
             std::int64_t damage = get_combat_damage( game_status , monster_id );
-            std::string damage_text;
-            if ( damage >= 0 )
-                damage_text = std::to_string( damage );
-            else
-                damage_text = std::string( "????" );
-            this->layout->set_text( damage_text );
-
-            cairo_context->save();
-            cairo_context->move_to( x*this->pixel_size , ( y + 0.5 )*this->pixel_size );
             double red_value = 0;
             double green_value = 0;
             if ( damage >= game_status->hero.life || damage < 0 )
@@ -361,93 +789,379 @@ namespace MagicTower
                 red_value = static_cast<double>( damage )/( game_status->hero.life );
                 green_value = 1 - red_value;
             }
-            cairo_context->set_source_rgb( red_value , green_value , 0.0 );
-            cairo_context->set_line_width( 0.5 );
-            this->layout->show_in_cairo_context( cairo_context );
-            cairo_context->fill_preserve();
+            //negative damage display as "????"
+            this->text_cache.draw_number( cairo_context , x*this->pixel_size , ( y + 0.5 )*this->pixel_size , damage ,
+                this->font_desc , red_value , green_value , 0.0 );
+        }
 
-            cairo_context->stroke();
-            cairo_context->restore();
+        //the whole grid image of current animation frame:transparent entity come pre-composited over the default floor by tile cache.
+        //animated:the grid image is a multi frame strip
+        Cairo::RefPtr<Cairo::ImageSurface> get_grid_tile( const TowerGrid& grid , std::uint32_t default_id , bool& animated )
+        {
+            std::string image_type;
+            std::uint32_t image_id = grid.id;
+            bool entity = true;
+            switch( grid.type )
+            {
+                case GRID_TYPE::BOUNDARY:
+                    image_type = "boundary";
+                    entity = false;
+                    break;
+                case GRID_TYPE::FLOOR:
+                    image_type = "floor";
+                    entity = false;
+                    break;
+                case GRID_TYPE::WALL:
+                    image_type = "wall";
+                    entity = false;
+                    break;
+                case GRID_TYPE::STAIRS:
+                    image_type = "stairs";
+                    image_id = this->game_status->stairs[ grid.id ].type;
+                    break;
+                case GRID_TYPE::DOOR:
+                    image_type = "door";
+                    break;
+                case GRID_TYPE::NPC:
+                    image_type = "npc";
+                    break;
+                case GRID_TYPE::MONSTER:
+                    image_type = "monster";
+                    break;
+                case GRID_TYPE::ITEM:
+                    image_type = "item";
+                    break;
+                default :
+                    image_type = "backup";
+                    image_id = 1;
+                    entity = false;
+                    break;
+            }
+            std::string image_path = ResourcesManager::get_image( image_type , image_id );
+            animated = ( this->sprite_cache.get_frame_count( image_path ) > 1 );
+            if ( entity )
+                return this->tile_cache.get_tile( this->sprite_cache , default_id , image_type , image_id , this->animation_frame );
+            return this->sprite_cache.get_sprite( image_path , this->animation_frame );
         }
 
-        //always return false to do other draw signal handler
-        bool draw_maps( const Cairo::RefPtr<Cairo::Context> & cairo_context )
+        //drop all chunks when the floor shape,grid size or sprites changed
+        FloorLayer& get_floor_layer( std::uint32_t floor_id )
         {
-            //todo: lazy refresh
-            GameStatus * game_status = this->game_status;
-            std::uint32_t default_id = this->game_status->game_map.map[ this->game_status->hero.floors ].default_floorid;
+            TowerFloor& floor = this->game_status->game_map.map[ floor_id ];
+            FloorLayer& layer = this->floor_layers[ floor_id ];
+            //sprite generation change:some placeholder grid can be replace by decoded sprite
+            if ( ( layer.pixel_size != this->pixel_size ) || ( layer.length != floor.length ) || ( layer.width != floor.width ) ||
+                ( layer.default_floorid != floor.default_floorid ) || ( layer.sprite_generation != this->sprite_cache.get_generation() ) )
+            {
+                layer.chunks.clear();
+                layer.length = floor.length;
+                layer.width = floor.width;
+                layer.default_floorid = floor.default_floorid;
+                layer.pixel_size = this->pixel_size;
+                layer.sprite_generation = this->sprite_cache.get_generation();
+            }
+            return layer;
+        }
 
-            auto offsets = this->get_draw_offsets();
-            std::uint32_t offset_x = offsets.first;
-            std::uint32_t offset_y = offsets.second;
+        //build the missing chunks of viewport at once when there are many:
+        //tiles are resolved on main thread,bands painted on worker threads,then composed and damage text drawn on main thread.
+        //update_layer_chunk find these chunks clean afterwards
+        void prebuild_layer_chunks( std::uint32_t floor_id , FloorLayer& layer , std::int64_t first_chunk_x , std::int64_t first_chunk_y ,
+            std::int64_t last_chunk_x , std::int64_t last_chunk_y )
+        {
+            TowerFloor& floor = this->game_status->game_map.map[ floor_id ];
+            Hero& hero = this->game_status->hero;
+            std::array<std::uint32_t,4> damage_key = { hero.level , hero.life , hero.attack , hero.defense };
 
-            for( size_t y = 0 ; y < this->max_grid_x ; y++ )
+            std::vector<std::pair<std::int64_t,std::int64_t>> missing_chunks;
+            std::size_t missing_grids = 0;
+            for ( std::int64_t chunk_y = first_chunk_y ; chunk_y <= last_chunk_y ; chunk_y++ )
             {
-                for ( size_t x = 0 ; x < this->max_grid_y ; x++ )
+                for ( std::int64_t chunk_x = first_chunk_x ; chunk_x <= last_chunk_x ; chunk_x++ )
                 {
-                    if ( !this->is_visible( x , y ) )
-                    {
-                        this->draw_grid_image( cairo_context , x , y , "backup" , 1 );
+                    std::uint64_t chunk_key = ( static_cast<std::uint64_t>( chunk_y ) << 32 ) | chunk_x;
+                    if ( layer.chunks.find( chunk_key ) != layer.chunks.end() )
                         continue;
-                    }
-                    auto grid = game_status->game_map.get_grid( game_status->hero.floors , x + offset_x , y + offset_y );
-                    switch( grid.type )
+                    missing_chunks.push_back( { chunk_x , chunk_y } );
+                    missing_grids += static_cast<std::size_t>( std::min<std::int64_t>( layer_chunk_size , static_cast<std::int64_t>( floor.length ) - chunk_x*layer_chunk_size ) )*
+                        std::min<std::int64_t>( layer_chunk_size , static_cast<std::int64_t>( floor.width ) - chunk_y*layer_chunk_size );
+                }
+            }
+            if ( missing_grids < parallel_rasterize_grids )
+                return ;
+
+            //hold the tiles until bands painted,tile cache may evict them meanwhile
+            std::vector<Cairo::RefPtr<Cairo::ImageSurface>> tiles;
+            std::vector<BandRasterizer::Band> bands;
+            //band index -> chunk key,first band row
+            std::vector<std::pair<std::uint64_t,std::uint32_t>> band_targets;
+            for ( auto& [ chunk_x , chunk_y ] : missing_chunks )
+            {
+                std::uint32_t start_x = chunk_x*layer_chunk_size;
+                std::uint32_t start_y = chunk_y*layer_chunk_size;
+                std::uint32_t chunk_length = std::min( layer_chunk_size , floor.length - start_x );
+                std::uint32_t chunk_width = std::min( layer_chunk_size , floor.width - start_y );
+                std::uint64_t chunk_key = ( static_cast<std::uint64_t>( chunk_y ) << 32 ) | chunk_x;
+
+                LayerChunk& chunk = layer.chunks[ chunk_key ];
+                chunk.last_used = this->frame_count;
+                chunk.composed = this->create_scaled_surface( chunk_length*this->pixel_size , chunk_width*this->pixel_size );
+                chunk.content.assign( chunk_length*chunk_width , { GRID_TYPE::UNKNOWN , 0 } );
+                chunk.animated.assign( chunk_length*chunk_width , 0 );
+                chunk.animated_count = 0;
+                chunk.animation_frame = this->animation_frame;
+                chunk.damage_key = damage_key;
+
+                for ( std::uint32_t band_y = 0 ; band_y < chunk_width ; band_y += layer_band_rows )
+                {
+                    BandRasterizer::Band band = { chunk_length , std::min( layer_band_rows , chunk_width - band_y ) , {} , {} };
+                    for ( std::uint32_t y = band_y ; y < band_y + band.width ; y++ )
                     {
-                        case GRID_TYPE::BOUNDARY:
-                        {
-                            this->draw_grid_image( cairo_context , x , y , "boundary" , grid.id );
-                            break;
-                        }
-                        case GRID_TYPE::FLOOR:
-                        {
-                            this->draw_grid_image( cairo_context , x , y , "floor" , grid.id );
-                            break;
-                        }
-                        case GRID_TYPE::WALL:
-                        {
-                            this->draw_grid_image( cairo_context , x , y , "wall" , grid.id );
-                            break;
-                        }
-                        case GRID_TYPE::STAIRS:
+                        for ( std::uint32_t x = 0 ; x < chunk_length ; x++ )
                         {
-                            this->draw_grid_image( cairo_context , x , y , "floor" , default_id );
-                            this->draw_grid_image( cairo_context , x , y , "stairs" , game_status->stairs[ grid.id ].type );
-                            break;
-                        }
-                        case GRID_TYPE::DOOR:
-                        {
-                            this->draw_grid_image( cairo_context , x , y , "floor" , default_id );
-                            this->draw_grid_image( cairo_context , x , y , "door" , grid.id );
-                            break;
+                            std::size_t floor_index = static_cast<std::size_t>( start_y + y )*floor.length + start_x + x;
+                            TowerGrid grid = { GRID_TYPE::UNKNOWN , 0 };
+                            if ( floor_index < floor.content.size() )
+                                grid = floor.content[ floor_index ];
+                            bool grid_animated = false;
+                            tiles.push_back( this->get_grid_tile( grid , floor.default_floorid , grid_animated ) );
+                            tiles.back()->flush();
+                            band.blits.push_back( BandRasterizer::make_blit( tiles.back() , x , y - band_y ) );
+                            chunk.content[ y*chunk_length + x ] = grid;
+                            chunk.animated[ y*chunk_length + x ] = grid_animated;
+                            if ( grid_animated )
+                                chunk.animated_count++;
                         }
-                        case GRID_TYPE::NPC:
-                        {
-                            this->draw_grid_image( cairo_context , x , y , "floor" , default_id );
-                            this->draw_grid_image( cairo_context , x , y , "npc" , grid.id );
-                            break;
-                        }
-                        case GRID_TYPE::MONSTER:
-                        {
-                            this->draw_grid_image( cairo_context , x , y , "floor" , default_id );
-                            this->draw_grid_image( cairo_context , x , y , "monster" , grid.id );
-                            this->draw_damage( cairo_context , x , y , grid.id );
-                            break;
-                        }
-                        case GRID_TYPE::ITEM:
-                        {
-                            this->draw_grid_image( cairo_context , x , y , "floor" , default_id );
-                            this->draw_grid_image( cairo_context , x , y , "item" , grid.id );
-                            break;
-                        }
-                        default :
+                    }
+                    bands.push_back( std::move( band ) );
+                    band_targets.push_back( { chunk_key , band_y } );
+                }
+            }
+
+            {
+                ScopedTimer timer( this->metrics , "rasterize_bands" );
+                this->band_rasterizer.rasterize( bands , this->pixel_size , this->scale_factor );
+            }
+
+            std::map<std::uint64_t,Cairo::RefPtr<Cairo::Context>> composed_contexts;
+            for ( std::size_t i = 0 ; i < bands.size() ; i++ )
+            {
+                auto& [ chunk_key , band_y ] = band_targets[i];
+                auto& composed_context = composed_contexts[ chunk_key ];
+                if ( !composed_context )
+                {
+                    composed_context = Cairo::Context::create( layer.chunks[ chunk_key ].composed );
+                    composed_context->set_operator( Cairo::Operator::OPERATOR_SOURCE );
+                }
+                composed_context->set_source( bands[i].surface , 0 , band_y*this->pixel_size );
+                composed_context->rectangle( 0 , band_y*this->pixel_size , bands[i].length*this->pixel_size , bands[i].width*this->pixel_size );
+                composed_context->fill();
+            }
+            for ( auto& [ chunk_key , composed_context ] : composed_contexts )
+            {
+                LayerChunk& chunk = layer.chunks[ chunk_key ];
+                std::uint32_t chunk_length = std::min( layer_chunk_size , floor.length - static_cast<std::uint32_t>( chunk_key )*layer_chunk_size );
+                composed_context->set_operator( Cairo::Operator::OPERATOR_OVER );
+                for ( std::size_t i = 0 ; i < chunk.content.size() ; i++ )
+                {
+                    if ( chunk.content[i].type != GRID_TYPE::MONSTER )
+                        continue;
+                    //same clip as the per grid redraw
+                    std::uint32_t x = i%chunk_length;
+                    std::uint32_t y = i/chunk_length;
+                    composed_context->save();
+                    composed_context->rectangle( x*this->pixel_size , y*this->pixel_size , this->pixel_size , this->pixel_size );
+                    composed_context->clip();
+                    this->draw_damage( composed_context , x , y , chunk.content[i].id );
+                    composed_context->restore();
+                }
+            }
+        }
+
+        //re-rasterize the grids of chunk whose input changed since last draw
+        LayerChunk& update_layer_chunk( std::uint32_t floor_id , FloorLayer& layer , std::uint32_t chunk_x , std::uint32_t chunk_y )
+        {
+            TowerFloor& floor = this->game_status->game_map.map[ floor_id ];
+            Hero& hero = this->game_status->hero;
+            std::array<std::uint32_t,4> damage_key = { hero.level , hero.life , hero.attack , hero.defense };
+
+            std::uint32_t start_x = chunk_x*layer_chunk_size;
+            std::uint32_t start_y = chunk_y*layer_chunk_size;
+            std::uint32_t chunk_length = std::min( layer_chunk_size , floor.length - start_x );
+            std::uint32_t chunk_width = std::min( layer_chunk_size , floor.width - start_y );
+            std::uint64_t chunk_key = ( static_cast<std::uint64_t>( chunk_y ) << 32 ) | chunk_x;
+
+            bool rebuild = ( layer.chunks.find( chunk_key ) == layer.chunks.end() );
+            LayerChunk& chunk = layer.chunks[ chunk_key ];
+            chunk.last_used = this->frame_count;
+            if ( rebuild )
+            {
+                chunk.composed = this->create_scaled_surface( chunk_length*this->pixel_size , chunk_width*this->pixel_size );
+                chunk.content.assign( chunk_length*chunk_width , { GRID_TYPE::UNKNOWN , 0 } );
+                chunk.animated.assign( chunk_length*chunk_width , 0 );
+                chunk.animated_count = 0;
+            }
+            bool animation_changed = ( chunk.animation_frame != this->animation_frame );
+            chunk.animation_frame = this->animation_frame;
+            bool damage_changed = ( chunk.damage_key != damage_key );
+            chunk.damage_key = damage_key;
+
+            Cairo::RefPtr<Cairo::Context> composed_context;
+            for ( std::uint32_t y = 0 ; y < chunk_width ; y++ )
+            {
+                for ( std::uint32_t x = 0 ; x < chunk_length ; x++ )
+                {
+                    std::size_t floor_index = static_cast<std::size_t>( start_y + y )*floor.length + start_x + x;
+                    TowerGrid grid = { GRID_TYPE::UNKNOWN , 0 };
+                    if ( floor_index < floor.content.size() )
+                        grid = floor.content[ floor_index ];
+                    TowerGrid& drawn_grid = chunk.content[ y*chunk_length + x ];
+                    std::uint8_t& animated = chunk.animated[ y*chunk_length + x ];
+                    bool grid_changed = rebuild || ( drawn_grid != grid );
+                    if ( !grid_changed && !( damage_changed && ( grid.type == GRID_TYPE::MONSTER ) ) && !( animation_changed && animated ) )
+                    {
+                        continue;
+                    }
+                    if ( !composed_context )
+                    {
+                        composed_context = Cairo::Context::create( chunk.composed );
+                    }
+
+                    //one blit replace the grid,damage text over it
+                    composed_context->save();
+                    composed_context->rectangle( x*this->pixel_size , y*this->pixel_size , this->pixel_size , this->pixel_size );
+                    composed_context->clip();
+                    composed_context->set_operator( Cairo::Operator::OPERATOR_SOURCE );
+                    bool grid_animated = false;
+                    composed_context->set_source( this->get_grid_tile( grid , floor.default_floorid , grid_animated ) , x*this->pixel_size , y*this->pixel_size );
+                    if ( grid_animated && !animated )
+                        chunk.animated_count++;
+                    else if ( !grid_animated && animated )
+                        chunk.animated_count--;
+                    animated = grid_animated;
+                    composed_context->paint();
+                    composed_context->set_operator( Cairo::Operator::OPERATOR_OVER );
+                    if ( grid.type == GRID_TYPE::MONSTER )
+                        this->draw_damage( composed_context , x , y , grid.id );
+                    composed_context->restore();
+
+                    drawn_grid = grid;
+                }
+            }
+
+            return chunk;
+        }
+
+        //evict the least recently drawn chunks until under layer_chunk_budget,chunks of this frame are kept
+        void trim_layer_chunks( void )
+        {
+            std::vector<std::tuple<std::uint64_t,std::uint32_t,std::uint64_t,std::size_t>> chunk_ages;
+            std::size_t total_bytes = 0;
+            for ( auto& layer : this->floor_layers )
+            {
+                for ( auto& chunk : layer.second.chunks )
+                {
+                    std::size_t bytes = 0;
+                    if ( chunk.second.composed )
+                        bytes = static_cast<std::size_t>( chunk.second.composed->get_stride() )*chunk.second.composed->get_height();
+                    chunk_ages.push_back( { chunk.second.last_used , layer.first , chunk.first , bytes } );
+                    total_bytes += bytes;
+                }
+            }
+            if ( total_bytes <= layer_chunk_budget )
+                return ;
+            std::sort( chunk_ages.begin() , chunk_ages.end() );
+            for ( auto& [ last_used , floor_id , chunk_key , bytes ] : chunk_ages )
+            {
+                if ( total_bytes <= layer_chunk_budget || last_used == this->frame_count )
+                    break;
+                this->floor_layers[ floor_id ].chunks.erase( chunk_key );
+                total_bytes -= bytes;
+            }
+        }
+
+        //always return false to do other draw signal handler
+        bool draw_maps( const Cairo::RefPtr<Cairo::Context> & cairo_context )
+        {
+            std::uint32_t floor_id = this->game_status->hero.floors;
+            if ( this->prefetched_floor != floor_id )
+            {
+                this->prefetch_floors( floor_id );
+            }
+            this->frame_count++;
+            Glib::RefPtr<Gdk::FrameClock> frame_clock;
+            if ( this->game_area != nullptr )
+                frame_clock = this->game_area->get_frame_clock();
+            this->metrics.frame_presented( frame_clock ? frame_clock->get_frame_time() : g_get_monotonic_time() );
+            this->update_camera();
+            auto camera = this->get_camera();
+            Gtk::Allocation allocation = this->get_tower_allocation();
+            TowerFloor& floor = this->game_status->game_map.map[ floor_id ];
+            FloorLayer& layer = this->get_floor_layer( floor_id );
+
+            //viewport in map coordinate,clamp to floor
+            auto first_grid = this->get_grid_location( 0 , 0 );
+            auto last_grid = this->get_grid_location( allocation.get_width() - 1 , allocation.get_height() - 1 );
+            std::int64_t first_x = std::max<std::int64_t>( first_grid.x , 0 );
+            std::int64_t first_y = std::max<std::int64_t>( first_grid.y , 0 );
+            std::int64_t last_x = std::min<std::int64_t>( last_grid.x , static_cast<std::int64_t>( floor.length ) - 1 );
+            std::int64_t last_y = std::min<std::int64_t>( last_grid.y , static_cast<std::int64_t>( floor.width ) - 1 );
+            bool animation_visible = false;
+
+            cairo_context->save();
+            //outside the floor,display as backup image(black)
+            cairo_context->set_source_rgb( 0 , 0 , 0 );
+            cairo_context->paint();
+            //draw in map pixel coordinate
+            cairo_context->translate( -camera.first , -camera.second );
+            if ( first_x <= last_x && first_y <= last_y )
+            {
+                this->prebuild_layer_chunks( floor_id , layer , first_x/layer_chunk_size , first_y/layer_chunk_size ,
+                    last_x/layer_chunk_size , last_y/layer_chunk_size );
+                for ( std::int64_t chunk_y = first_y/layer_chunk_size ; chunk_y <= last_y/layer_chunk_size ; chunk_y++ )
+                {
+                    for ( std::int64_t chunk_x = first_x/layer_chunk_size ; chunk_x <= last_x/layer_chunk_size ; chunk_x++ )
+                    {
+                        LayerChunk& chunk = this->update_layer_chunk( floor_id , layer , chunk_x , chunk_y );
+                        animation_visible = animation_visible || ( chunk.animated_count > 0 );
+                        double chunk_origin_x = static_cast<double>( chunk_x*layer_chunk_size )*this->pixel_size;
+                        double chunk_origin_y = static_cast<double>( chunk_y*layer_chunk_size )*this->pixel_size;
+                        cairo_context->set_source( chunk.composed , chunk_origin_x , chunk_origin_y );
+                        cairo_context->rectangle( chunk_origin_x , chunk_origin_y ,
+                            chunk.composed->get_width()/this->scale_factor , chunk.composed->get_height()/this->scale_factor );
+                        cairo_context->fill();
+                    }
+                }
+
+                //field vision fog overlay,visible grid only
+                this->update_vision();
+                for ( std::int64_t y = first_y ; y <= last_y ; y++ )
+                {
+                    for ( std::int64_t x = first_x ; x <= last_x ; x++ )
+                    {
+                        if ( !this->is_visible( x , y ) )
                         {
                             this->draw_grid_image( cairo_context , x , y , "backup" , 1 );
-                            break;
                         }
                     }
                 }
             }
+            cairo_context->restore();
+            this->trim_layer_chunks();
+
+            //animation clock run only when animated grid in viewport
+            this->animation_visible = animation_visible;
+            if ( animation_visible && !this->animation_ticking && this->game_area != nullptr )
+            {
+                this->animation_ticking = true;
+                this->game_area->add_tick_callback( sigc::mem_fun( *this , &GameWindowImp::animation_tick ) );
+            }
 
+            if ( !this->first_frame_drawn )
+            {
+                this->first_frame_drawn = true;
+                g_log( __func__ , G_LOG_LEVEL_MESSAGE , "first frame drawn after %.3f ms" , ( g_get_monotonic_time() - this->startup_time )/1000.0 );
+            }
             return false;
         }
 
@@ -462,30 +1176,31 @@ namespace MagicTower
             if ( !game_status->draw_path )
                 return false;
 
-            auto offsets = this->get_draw_offsets();
+            auto camera = this->get_camera();
             double draw_x = 0;
             double draw_y = 0;
 
             cairo_context->save();
+            cairo_context->translate( -camera.first , -camera.second );
             cairo_context->set_source_rgba( 1.0 , 0.2 , 0.2 , 1.0 );
             cairo_context->set_line_width( 4.0 );
             
-            draw_x = ( game_status->path[0] ).x - offsets.first + 0.5;
-            draw_y = ( game_status->path[0] ).y - offsets.second + 0.5;
+            draw_x = ( game_status->path[0] ).x + 0.5;
+            draw_y = ( game_status->path[0] ).y + 0.5;
 
             cairo_context->arc( draw_x*this->pixel_size , draw_y*this->pixel_size , 0.1*this->pixel_size , 0 , 2*G_PI );
             cairo_context->fill();
             for ( auto point : game_status->path )
             {
-                draw_x = ( point ).x - offsets.first + 0.5;
-                draw_y = ( point ).y - offsets.second + 0.5;
+                draw_x = ( point ).x + 0.5;
+                draw_y = ( point ).y + 0.5;
 
                 cairo_context->line_to( draw_x*this->pixel_size , draw_y*this->pixel_size );
                 cairo_context->move_to( draw_x*this->pixel_size , draw_y*this->pixel_size );
             }
 
-            draw_x = ( game_status->hero ).x - offsets.first + 0.5;
-            draw_y = ( game_status->hero ).y - offsets.second + 0.5;
+            draw_x = ( game_status->hero ).x + 0.5;
+            draw_y = ( game_status->hero ).y + 0.5;
 
             cairo_context->line_to( draw_x*this->pixel_size , draw_y*this->pixel_size );
             cairo_context->stroke();
@@ -512,13 +1227,184 @@ namespace MagicTower
             {
                 return false;
             }
-            auto offsets = this->get_draw_offsets();
-            std::uint32_t draw_x = 0;
-            std::uint32_t draw_y = 0;
+            auto camera = this->get_camera();
+            cairo_context->save();
+            cairo_context->translate( -camera.first , -camera.second );
+            draw_grid_image( cairo_context , game_status->hero.x , game_status->hero.y , "hero" , static_cast<int>( game_status->hero.direction ) );
+            cairo_context->restore();
+
+            return false;
+        }
+
+        //always return false to do other draw signal handler
+        bool draw_minimap( const Cairo::RefPtr<Cairo::Context> & cairo_context )
+        {
+            GameStatus * game_status = this->game_status;
+            if ( !this->show_minimap )
+                return false;
+            if ( game_status->state != GAME_STATE::NORMAL && game_status->state != GAME_STATE::FIND_PATH )
+                return false;
+            std::uint32_t floor_id = game_status->hero.floors;
+            TowerFloor& floor = game_status->game_map.map[ floor_id ];
+            //thumbnail would show the grids under the fog
+            if ( floor.field_vision.has_value() )
+                return false;
+
+            this->thumbnail_cache.refresh( game_status->game_map , { floor_id } , game_status->stairs , this->sprite_cache );
+            auto thumbnail = this->thumbnail_cache.get_thumbnail( floor_id );
+            if ( !thumbnail )
+                return false;
+
+            //top right corner,at most a quarter of the shorter side
+            Gtk::Allocation allocation = this->get_tower_allocation();
+            double minimap_limit = std::min( allocation.get_width() , allocation.get_height() )/4.0;
+            double scale = minimap_limit/std::max( thumbnail->get_width() , thumbnail->get_height() );
+            double minimap_width = thumbnail->get_width()*scale;
+            double minimap_height = thumbnail->get_height()*scale;
+            double minimap_x = allocation.get_width() - minimap_width - 8;
+            double minimap_y = 8;
+            //map pixel -> minimap pixel
+            double map_scale = minimap_width/( static_cast<double>( floor.length )*this->pixel_size );
+            auto camera = this->get_camera();
+
+            cairo_context->save();
+            cairo_context->set_source_rgba( 43.0/255 , 42.0/255 , 43.0/255 , 0.7 );
+            cairo_context->rectangle( minimap_x - 2 , minimap_y - 2 , minimap_width + 4 , minimap_height + 4 );
+            cairo_context->fill();
+
+            cairo_context->save();
+            cairo_context->translate( minimap_x , minimap_y );
+            cairo_context->scale( scale , scale );
+            cairo_context->set_source( thumbnail , 0 , 0 );
+            Cairo::RefPtr<Cairo::SurfacePattern>::cast_static( cairo_context->get_source() )->set_filter( Cairo::Filter::FILTER_NEAREST );
+            cairo_context->paint();
+            cairo_context->restore();
+
+            //viewport and hero
+            cairo_context->rectangle( minimap_x , minimap_y , minimap_width , minimap_height );
+            cairo_context->clip();
+            cairo_context->set_line_width( 1 );
+            cairo_context->set_source_rgb( 1.0 , 1.0 , 1.0 );
+            cairo_context->rectangle( minimap_x + camera.first*map_scale , minimap_y + camera.second*map_scale ,
+                allocation.get_width()*map_scale , allocation.get_height()*map_scale );
+            cairo_context->stroke();
+            cairo_context->set_source_rgb( 255/255.0 , 125/255.0 , 0/255.0 );
+            cairo_context->arc( minimap_x + ( game_status->hero.x + 0.5 )*this->pixel_size*map_scale ,
+                minimap_y + ( game_status->hero.y + 0.5 )*this->pixel_size*map_scale , std::max( 2.0 , this->pixel_size*map_scale/2 ) , 0 , 2*G_PI );
+            cairo_context->fill();
+            cairo_context->restore();
+
+            return false;
+        }
+
+        //floor browser cell layout:( columns , rows ) fill the tower area in map order
+        std::pair<std::size_t,std::size_t> get_browser_layout( void )
+        {
+            Gtk::Allocation allocation = this->get_tower_allocation();
+            std::size_t floor_count = std::max<std::size_t>( this->game_status->game_map.map.size() , 1 );
+            double aspect = static_cast<double>( std::max( allocation.get_width() , 1 ) )/std::max( allocation.get_height() , 1 );
+            std::size_t columns = std::max<std::size_t>( std::ceil( std::sqrt( floor_count*aspect ) ) , 1 );
+            std::size_t rows = ( floor_count + columns - 1 )/columns;
+            return { columns , rows };
+        }
+
+        void select_browser_floor( std::int64_t index )
+        {
+            auto& tower_map = this->game_status->game_map.map;
+            if ( index < 0 || index >= static_cast<std::int64_t>( tower_map.size() ) )
+                return ;
+            this->browser_floor = std::next( tower_map.begin() , index )->first;
+        }
+
+        //the browser open at the jump menu preview floor
+        std::uint32_t get_browser_floor( void )
+        {
+            return this->browser_floor.value_or( this->game_status->hero.floors );
+        }
+
+        //back to jump menu,confirm:preview the selected floor there
+        void close_floor_browser( bool confirm )
+        {
+            if ( confirm )
+                this->game_status->hero.floors = this->get_browser_floor();
+            this->browser_floor.reset();
+            this->game_status->state = GAME_STATE::JUMP_MENU;
+        }
+
+        std::int64_t get_browser_index( void )
+        {
+            auto& tower_map = this->game_status->game_map.map;
+            auto iter = tower_map.find( this->get_browser_floor() );
+            if ( iter == tower_map.end() )
+                return 0;
+            return std::distance( tower_map.begin() , iter );
+        }
+
+        //always return false to do other draw signal handler
+        bool draw_floor_browser( const Cairo::RefPtr<Cairo::Context> & cairo_context )
+        {
+            GameStatus * game_status = this->game_status;
+            if ( game_status->state != GAME_STATE::FLOOR_BROWSER )
+                return false;
+
+            std::vector<std::uint32_t> floor_ids;
+            for ( auto& floor : game_status->game_map.map )
+            {
+                //thumbnail would show the grids under the fog
+                if ( !floor.second.field_vision.has_value() )
+                    floor_ids.push_back( floor.first );
+            }
+            this->thumbnail_cache.refresh( game_status->game_map , floor_ids , game_status->stairs , this->sprite_cache );
+
+            Gtk::Allocation allocation = this->get_tower_allocation();
+            auto [ columns , rows ] = this->get_browser_layout();
+            double cell_width = static_cast<double>( allocation.get_width() )/columns;
+            double cell_height = static_cast<double>( allocation.get_height() )/rows;
+
+            cairo_context->save();
+            cairo_context->set_source_rgb( 0 , 0 , 0 );
+            cairo_context->paint();
+            std::size_t index = 0;
+            for ( auto& [ floor_id , floor ] : game_status->game_map.map )
+            {
+                double cell_x = ( index%columns )*cell_width;
+                double cell_y = ( index/columns )*cell_height;
+                index++;
+
+                auto name_text = this->text_cache.get_text( floor.name , this->font_desc , 1.0 , 1.0 , 1.0 );
+                double name_height = std::min<double>( name_text.height , cell_height/3 );
+                double image_width = cell_width - 8;
+                double image_height = cell_height - 8 - name_height;
+                auto thumbnail = this->thumbnail_cache.get_thumbnail( floor_id );
+                if ( thumbnail && image_width > 0 && image_height > 0 )
+                {
+                    double scale = std::min( image_width/thumbnail->get_width() , image_height/thumbnail->get_height() );
+                    double image_x = cell_x + ( cell_width - thumbnail->get_width()*scale )/2;
+                    double image_y = cell_y + 4;
+                    cairo_context->save();
+                    cairo_context->translate( image_x , image_y );
+                    cairo_context->scale( scale , scale );
+                    cairo_context->set_source( thumbnail , 0 , 0 );
+                    Cairo::RefPtr<Cairo::SurfacePattern>::cast_static( cairo_context->get_source() )->set_filter( Cairo::Filter::FILTER_NEAREST );
+                    cairo_context->paint();
+                    cairo_context->restore();
+                }
+
+                double name_x = cell_x + std::max( ( cell_width - name_text.width )/2 , 0.0 );
+                double name_y = cell_y + cell_height - 4 - name_height;
+                cairo_context->set_source( name_text.surface , name_x , name_y );
+                cairo_context->rectangle( name_x , name_y , std::min<double>( name_text.width , cell_width ) , name_height );
+                cairo_context->fill();
 
-            draw_x = ( game_status->hero ).x - offsets.first;
-            draw_y = ( game_status->hero ).y - offsets.second;
-            draw_grid_image( cairo_context , draw_x , draw_y , "hero" , static_cast<int>( game_status->hero.direction ) );
+                if ( floor_id == this->get_browser_floor() )
+                {
+                    cairo_context->set_source_rgba( 255/255.0 , 125/255.0 , 0/255.0 , 1.0 );
+                    cairo_context->set_line_width( 2 );
+                    cairo_context->rectangle( cell_x + 2 , cell_y + 2 , cell_width - 4 , cell_height - 4 );
+                    cairo_context->stroke();
+                }
+            }
+            cairo_context->restore();
 
             return false;
         }
@@ -530,11 +1416,11 @@ namespace MagicTower
             if ( game_status->state != GAME_STATE::REVIEW_DETAIL )
                 return false;
 
-            auto offsets = this->get_draw_offsets();
-            std::uint32_t x = this->click_x/this->pixel_size + offsets.first;
-            std::uint32_t y = this->click_y/this->pixel_size + offsets.second;
+            auto location = this->get_grid_location( this->click_x , this->click_y );
             std::string detail_str;
-            auto grid = game_status->game_map.get_grid( game_status->hero.floors , x , y );
+            TowerGrid grid = { GRID_TYPE::UNKNOWN , 0 };
+            if ( location.x >= 0 && location.y >= 0 )
+                grid = game_status->game_map.get_grid( game_status->hero.floors , location.x , location.y );
             if ( grid.type == GRID_TYPE::MONSTER )
             {
                 if ( game_status->monsters.find( grid.id ) != game_status->monsters.end() )
@@ -649,16 +1535,49 @@ namespace MagicTower
                 cairo_context->set_line_width( 0.5 );
                 cairo_context->stroke();
             }
+            if ( game_status->focus_item_id < game_status->slot_menu_ids.size() )
+            {
+                this->draw_slot_preview( cairo_context , menu_rectangle , game_status->slot_menu_ids[ game_status->focus_item_id ] );
+            }
             cairo_context->restore();
 
             return false;
         }
 
-        //draw signal handler end
+        //grid type map of the save slot hero floor,bottom right of menu box,from save index only
+        void draw_slot_preview( const Cairo::RefPtr<Cairo::Context> & cairo_context , const Gdk::Rectangle& menu_rectangle , std::size_t slot_id )
+        {
+            //color of GRID_TYPE,BOUNDARY .. UNKNOWN
+            static const double grid_colors[][3] = {
+                { 0.0 , 0.0 , 0.0 } , { 0.55 , 0.5 , 0.4 } , { 0.35 , 0.2 , 0.1 } , { 1.0 , 1.0 , 1.0 } , { 0.95 , 0.8 , 0.1 } ,
+                { 0.2 , 0.7 , 0.3 } , { 0.85 , 0.15 , 0.15 } , { 0.2 , 0.4 , 0.9 } , { 0.15 , 0.15 , 0.15 }
+            };
+            const std::map<std::size_t,SaveSlotInfo>& slots = this->game_status->save_service.get_slots();
+            auto slot_iter = slots.find( slot_id );
+            if ( slot_iter == slots.end() || slot_iter->second.thumbnail.empty() )
+                return ;
+            const SaveSlotInfo& info = slot_iter->second;
+            double preview_size = std::min( menu_rectangle.get_width()/4.0 , menu_rectangle.get_height()/3.0 );
+            double cell_size = preview_size/std::max( info.thumbnail_length , info.thumbnail_width );
+            double start_x = menu_rectangle.get_x() + menu_rectangle.get_width() - 6 - cell_size*info.thumbnail_length;
+            double start_y = menu_rectangle.get_y() + menu_rectangle.get_height() - 6 - cell_size*info.thumbnail_width;
+            for ( std::uint32_t y = 0 ; y < info.thumbnail_width ; y++ )
+            {
+                for ( std::uint32_t x = 0 ; x < info.thumbnail_length ; x++ )
+                {
+                    std::size_t type = std::min<std::size_t>( info.thumbnail[ y*info.thumbnail_length + x ] , static_cast<std::size_t>( GRID_TYPE::UNKNOWN ) );
+                    cairo_context->set_source_rgb( grid_colors[type][0] , grid_colors[type][1] , grid_colors[type][2] );
+                    cairo_context->rectangle( start_x + x*cell_size , start_y + y*cell_size , cell_size , cell_size );
+                    cairo_context->fill();
+                }
+            }
+        }
+
+        //always return false to do other draw signal handler
         bool draw_message( const Cairo::RefPtr<Cairo::Context> & cairo_context )
         {
             GameStatus * game_status = this->game_status;
-            Gdk::Rectangle maximum_rectangle = this->game_area->get_allocation();
+            Gdk::Rectangle maximum_rectangle = this->get_tower_allocation();
             switch ( game_status->state )
             {
                 case GAME_STATE::MESSAGE:
@@ -666,10 +1585,10 @@ namespace MagicTower
                 case GAME_STATE::GAME_WIN:
                     break;
                 default:
-                    return true;
+                    return false;
             }
             if ( game_status->game_message.empty() )
-                return true;
+                return false;
 
             const int widget_width = maximum_rectangle.get_width();
             const int widget_height = maximum_rectangle.get_height();
@@ -706,6 +1625,46 @@ namespace MagicTower
             cairo_context->fill_preserve();
             cairo_context->stroke();
             cairo_context->restore();
+            return false;
+        }
+
+        //draw signal handler end,debug HUD(F3)
+        bool draw_metrics( const Cairo::RefPtr<Cairo::Context> & cairo_context )
+        {
+            if ( !this->show_metrics )
+                return true;
+
+            char line[128];
+            std::string hud_text;
+            g_snprintf( line , sizeof( line ) , "FPS %.1f\n" , this->metrics.get_fps() );
+            hud_text += line;
+            for ( auto& [ name , ring ] : this->metrics.get_series() )
+            {
+                g_snprintf( line , sizeof( line ) , "%s p50 %.2f p99 %.2f ms\n" , name.c_str() ,
+                    ring.percentile( 50 ) , ring.percentile( 99 ) );
+                hud_text += line;
+            }
+            //text change every frame,text cache would only churn
+            if ( !this->metrics_layout )
+            {
+                this->metrics_layout = Pango::Layout::create( this->layout->get_context() );
+                this->metrics_layout->set_font_description( Pango::FontDescription( "Monospace 9" ) );
+            }
+            this->metrics_layout->set_text( hud_text );
+            int layout_width , layout_height;
+            this->metrics_layout->get_pixel_size( layout_width , layout_height );
+            Gtk::Allocation allocation = this->get_tower_allocation();
+            double hud_x = 4;
+            double hud_y = allocation.get_height() - layout_height - 4;
+
+            cairo_context->save();
+            cairo_context->set_source_rgba( 0 , 0 , 0 , 0.6 );
+            cairo_context->rectangle( hud_x - 2 , hud_y - 2 , layout_width + 4 , layout_height + 4 );
+            cairo_context->fill();
+            cairo_context->move_to( hud_x , hud_y );
+            cairo_context->set_source_rgb( 0.4 , 1.0 , 0.4 );
+            this->metrics_layout->show_in_cairo_context( cairo_context );
+            cairo_context->restore();
             return true;
         }
 
@@ -719,9 +1678,10 @@ namespace MagicTower
             layout_width += this->pixel_size/2;
             layout_height += this->pixel_size/2;
 
-            if ( static_cast<std::uint32_t>( x + layout_width ) > ( this->max_grid_x )*this->pixel_size )
+            Gtk::Allocation allocation = this->get_tower_allocation();
+            if ( static_cast<std::int64_t>( x + layout_width ) > allocation.get_width() )
                 x -= layout_width;
-            if ( static_cast<std::uint32_t>( y + layout_height ) > ( this->max_grid_y )*this->pixel_size)
+            if ( static_cast<std::int64_t>( y + layout_height ) > allocation.get_height() )
                 y -= layout_height;
 
             cairo_context->save();
@@ -745,38 +1705,79 @@ namespace MagicTower
         bool draw_info( const Cairo::RefPtr<Cairo::Context> & cairo_context )
         {
             Hero& hero = this->game_status->hero;
-            //draw background image
-            Gdk::Cairo::set_source_pixbuf( cairo_context , this->info_frame , 0.0 , 0.0 );
-            cairo_context->paint();
+            Gtk::Allocation allocation = this->get_info_allocation();
+            const int widget_width = allocation.get_width();
+            const int widget_height = allocation.get_height();
+            if ( widget_width <= 0 || widget_height <= 0 )
+                return true;
+
+            //background image or widget size changed,redraw whole panel
+            if ( !this->info_frame || this->info_frame_generation != this->sprite_cache.get_generation() ||
+                !this->info_panel.surface || this->info_panel.surface->get_width() != static_cast<int>( widget_width*this->scale_factor ) ||
+                this->info_panel.surface->get_height() != static_cast<int>( widget_height*this->scale_factor ) )
+            {
+                this->info_frame_generation = this->sprite_cache.get_generation();
+                this->info_frame = info_background_image_factory( widget_width , widget_height );
+                this->info_panel.surface = this->create_scaled_surface( widget_width , widget_height );
+                this->info_panel.dirty.set();
+            }
 
-            //draw text
-            std::vector< std::pair<std::string , int >> arr =
-            {
-                { this->game_status->game_map.map[hero.floors].name , 2 },
-                { std::string( "等   级:  " ) + std::to_string( hero.level ) , 0 },
-                { std::string( "生命值:  " ) + std::to_string( hero.life ) , 0 },
-                { std::string( "攻击力:  " ) + std::to_string( hero.attack ) , 0 },
-                { std::string( "防御力:  " ) + std::to_string( hero.defense ) , 0 },
-                { std::string( "金   币:  " ) + std::to_string( hero.gold ) , 0 },
-                { std::string( "经验值:  " ) + std::to_string( hero.experience ) , 0 },
-                { std::string( "黄钥匙:  " ) + std::to_string( hero.yellow_key ) , 0 },
-                { std::string( "蓝钥匙:  " ) + std::to_string( hero.blue_key ) , 0 },
-                { std::string( "红钥匙:  " ) + std::to_string( hero.red_key ) , 0 },
-                { std::string( "按键说明(F1)" ) , 2 }
+            //mark the line of changed field
+            std::string floor_name = this->game_status->game_map.map[hero.floors].name;
+            std::array<std::int64_t,info_value_count> values =
+            {
+                hero.level , hero.life , hero.attack , hero.defense , hero.gold ,
+                hero.experience , hero.yellow_key , hero.blue_key , hero.red_key
             };
+            if ( floor_name != this->info_panel.floor_name )
+                this->info_panel.dirty.set( 0 );
+            for ( std::size_t i = 0 ; i < info_value_count ; i++ )
+            {
+                if ( values[i] != this->info_panel.values[i] )
+                    this->info_panel.dirty.set( i + 1 );
+            }
+            this->info_panel.floor_name = floor_name;
+            this->info_panel.values = values;
+            if ( this->info_panel.dirty.any() )
+                this->update_info_panel( widget_width , widget_height );
 
-            Gtk::Allocation allocation = this->info_area->get_allocation();
-            const int widget_width = allocation.get_width();
-            const int widget_height = allocation.get_height();
-            std::size_t arr_size = arr.size();
-            for ( std::size_t i = 0 ; i < arr_size ; i++ )
+            cairo_context->set_source( this->info_panel.surface , 0.0 , 0.0 );
+            cairo_context->paint();
+
+            return true;
+        }
+
+        //redraw the dirty lines of info panel,each line repaint the background of its band first
+        void update_info_panel( int widget_width , int widget_height )
+        {
+            //label,show value,align
+            static const std::array< std::tuple<const char * , bool , int > , info_line_count > lines =
+            {{
+                { nullptr , false , 2 },
+                { "等   级:  " , true , 0 },
+                { "生命值:  " , true , 0 },
+                { "攻击力:  " , true , 0 },
+                { "防御力:  " , true , 0 },
+                { "金   币:  " , true , 0 },
+                { "经验值:  " , true , 0 },
+                { "黄钥匙:  " , true , 0 },
+                { "蓝钥匙:  " , true , 0 },
+                { "红钥匙:  " , true , 0 },
+                { "按键说明(F1)" , false , 2 }
+            }};
+
+            auto cairo_context = Cairo::Context::create( this->info_panel.surface );
+            for ( std::size_t i = 0 ; i < info_line_count ; i++ )
             {
-                this->layout->set_text( arr[i].first );
+                if ( !this->info_panel.dirty.test( i ) )
+                    continue;
+                auto& [ label_text , show_value , align ] = lines[i];
+                std::string label = ( label_text == nullptr ) ? this->info_panel.floor_name : std::string( label_text );
+                auto label_text = this->text_cache.get_text( label , this->font_desc , 0.4 , 0.3 , 0.4 );
 
                 int pos = 0;
-                int layout_width = 0 , layout_height = 0;
-                this->layout->get_pixel_size( layout_width , layout_height );
-                switch ( arr[i].second )
+                int layout_width = label_text.width;
+                switch ( align )
                 {
                     case 0:
                         pos = 0;
@@ -795,17 +1796,26 @@ namespace MagicTower
                         break;
                 }
 
+                int line_y = widget_height/info_line_count*i;
+                int line_end = ( i + 1 == info_line_count ) ? widget_height : widget_height/info_line_count*( i + 1 );
                 cairo_context->save();
-                cairo_context->move_to( pos , widget_height/arr_size*i );
-                cairo_context->set_source_rgb( 0.4 , 0.3 , 0.4 );
-                cairo_context->set_line_width( 0.5 );
-                this->layout->show_in_cairo_context( cairo_context );
-                cairo_context->fill_preserve();
-                cairo_context->stroke();
+                cairo_context->rectangle( 0 , line_y , widget_width , line_end - line_y );
+                cairo_context->clip();
+                cairo_context->set_operator( Cairo::Operator::OPERATOR_SOURCE );
+                cairo_context->set_source( this->info_frame , 0.0 , 0.0 );
+                cairo_context->paint();
+                cairo_context->set_operator( Cairo::Operator::OPERATOR_OVER );
+                cairo_context->set_source( label_text.surface , pos , line_y );
+                cairo_context->rectangle( pos , line_y , layout_width , label_text.height );
+                cairo_context->fill();
+                if ( show_value )
+                {
+                    this->text_cache.draw_number( cairo_context , pos + layout_width , line_y , this->info_panel.values[ i - 1 ] ,
+                        this->font_desc , 0.4 , 0.3 , 0.4 );
+                }
                 cairo_context->restore();
             }
-
-            return true;
+            this->info_panel.dirty.reset();
         }
 
         bool scroll_signal_handler( GdkEventScroll * event )
@@ -859,11 +1869,22 @@ namespace MagicTower
 
         bool key_press_handler( GdkEventKey * event )
         {
+            ScopedTimer handler_timer( this->metrics , "key_press_handler" );
+            this->metrics.key_pressed( event->time );
             if ( !this->draw_connection.connected() )
             {
                 this->draw_connection = Glib::signal_timeout().connect( sigc::mem_fun( *this , &GameWindowImp::refresh_draw ) , 100 );
             }
+            //debug HUD,any state
+            if ( event->keyval == GDK_KEY_F3 )
+            {
+                this->show_metrics = !this->show_metrics;
+                this->game_area->queue_draw();
+                return true;
+            }
             GameStatus * game_status = this->game_status;
+            //one undo step per key press
+            ActionScope action( game_status );
             switch ( game_status->state )
             {
                 case GAME_STATE::DIALOG:
@@ -879,31 +1900,35 @@ namespace MagicTower
                         case GDK_KEY_F1:
                         {
                             game_status->game_message = {
-                                std::string( "\n\n方向键移动(或使用鼠标)\n\n改变人物朝向(T/t)\n\n游戏菜单(ESC)\n\n商店菜单(S/s)\n\n楼层跳跃/浏览器(J/j)\n\n物品栏(I/i)\n\n")
+                                std::string( "\n\n方向键移动(或使用鼠标)\n\n改变人物朝向(T/t)\n\n游戏菜单(ESC)\n\n商店菜单(S/s)\n\n楼层跳跃/浏览器(J/j)\n\n物品栏(I/i)\n\n小地图(M/m)\n\n快速存档/读档(F5/F9,Shift+F9更早)\n\n撤销/重做(Ctrl+Z/Ctrl+Y)\n\n调试信息(F3)\n\n")
                             };
                             game_status->state = GAME_STATE::MESSAGE;
                             break;
                         }
                         case GDK_KEY_Left:
                         {
+                            ScopedTimer timer( this->metrics , "move_hero" );
                             move_hero( game_status , { game_status->hero.floors , game_status->hero.x - 1 , game_status->hero.y } );
                             game_status->hero.direction = DIRECTION::LEFT;
                             break;
                         }
                         case GDK_KEY_Right:
                         {
+                            ScopedTimer timer( this->metrics , "move_hero" );
                             move_hero( game_status , { game_status->hero.floors , game_status->hero.x + 1 , game_status->hero.y } );
                             game_status->hero.direction = DIRECTION::RIGHT;
                             break;
                         }
                         case GDK_KEY_Up:
                         {
+                            ScopedTimer timer( this->metrics , "move_hero" );
                             move_hero( game_status , { game_status->hero.floors , game_status->hero.x , game_status->hero.y - 1 } );
                             game_status->hero.direction = DIRECTION::UP;
                             break;
                         }
                         case GDK_KEY_Down:
                         {
+                            ScopedTimer timer( this->metrics , "move_hero" );
                             move_hero( game_status , { game_status->hero.floors , game_status->hero.x , game_status->hero.y + 1 } );
                             game_status->hero.direction = DIRECTION::DOWN;
                             break;
@@ -937,6 +1962,83 @@ namespace MagicTower
                             open_inventories_menu( game_status );
                             break;
                         }
+                        case GDK_KEY_M:
+                        case GDK_KEY_m:
+                        {
+                            this->show_minimap = !this->show_minimap;
+                            break;
+                        }
+                        case GDK_KEY_F5:
+                        {
+                            ScopedTimer timer( this->metrics , "quick_save" );
+                            quick_save( game_status );
+                            break;
+                        }
+                        case GDK_KEY_F9:
+                        {
+                            ScopedTimer timer( this->metrics , "quick_load" );
+                            quick_load( game_status , ( event->state & GDK_SHIFT_MASK ) != 0 );
+                            break;
+                        }
+                        case GDK_KEY_Z:
+                        case GDK_KEY_z:
+                        {
+                            if ( ( event->state & GDK_CONTROL_MASK ) == 0 )
+                                break;
+                            //Ctrl+Shift+Z same as Ctrl+Y
+                            if ( ( event->state & GDK_SHIFT_MASK ) != 0 )
+                                redo_action( game_status );
+                            else
+                                undo_action( game_status );
+                            break;
+                        }
+                        case GDK_KEY_Y:
+                        case GDK_KEY_y:
+                        {
+                            if ( ( event->state & GDK_CONTROL_MASK ) != 0 )
+                                redo_action( game_status );
+                            break;
+                        }
+                        default :
+                            break;
+                    }
+                    break;
+                }
+                case GAME_STATE::FLOOR_BROWSER:
+                {
+                    std::int64_t columns = this->get_browser_layout().first;
+                    switch( event->keyval )
+                    {
+                        case GDK_KEY_Left:
+                        {
+                            this->select_browser_floor( this->get_browser_index() - 1 );
+                            break;
+                        }
+                        case GDK_KEY_Right:
+                        {
+                            this->select_browser_floor( this->get_browser_index() + 1 );
+                            break;
+                        }
+                        case GDK_KEY_Up:
+                        {
+                            this->select_browser_floor( this->get_browser_index() - columns );
+                            break;
+                        }
+                        case GDK_KEY_Down:
+                        {
+                            this->select_browser_floor( this->get_browser_index() + columns );
+                            break;
+                        }
+                        case GDK_KEY_Return:
+                        {
+                            this->close_floor_browser( true );
+                            break;
+                        }
+                        case GDK_KEY_Escape:
+                        {
+                            this->close_floor_browser( false );
+                            break;
+                        }
                         default :
                             break;
                     }
@@ -1071,6 +2173,7 @@ namespace MagicTower
                 this->draw_connection = Glib::signal_timeout().connect( sigc::mem_fun( *this , &GameWindowImp::refresh_draw ) , 100 );
             }
             GameStatus * game_status = this->game_status;
+            ActionScope action( game_status );
             gint x = event->x , y = event->y;
 
             switch ( event->type )
@@ -1103,9 +2206,11 @@ namespace MagicTower
                         case GAME_STATE::NORMAL:
                         case GAME_STATE::FIND_PATH:
                         {
+                            auto location = this->get_grid_location( x , y );
+                            this->update_vision();
                             if ( ( event->button == 3 ) && ( game_status->state == GAME_STATE::NORMAL ) )
                             {
-                                if ( !this->is_visible( x/this->pixel_size , y/this->pixel_size ) )
+                                if ( !this->is_visible( location.x , location.y ) )
                                 {
                                     break;
                                 }
@@ -1116,11 +2221,10 @@ namespace MagicTower
                             }
                             else if ( event->button == 1 )
                             {
-                                auto offsets = this->get_draw_offsets();
-                                game_status->path = find_path( game_status , { x/this->pixel_size + offsets.first , y/this->pixel_size + offsets.second } , 
-                                    [ this , offsets ]( std::uint32_t x , std::uint32_t y ) -> bool {
-                                        //check screen position
-                                        return this->is_visible( x - offsets.first , y - offsets.second );
+                                game_status->path = find_path( game_status , location , 
+                                    [ this ]( std::uint32_t x , std::uint32_t y ) -> bool {
+                                        //same mask as fog overlay,map coordinate
+                                        return this->is_visible( x , y );
                                 });
                                 game_status->state = GAME_STATE::FIND_PATH;
                                 if ( !this->findpath_connection.connected() )
@@ -1149,6 +2253,17 @@ namespace MagicTower
                             }
                             break;
                         }
+                        case GAME_STATE::FLOOR_BROWSER:
+                        {
+                            //pick the floor and back to jump menu
+                            Gtk::Allocation allocation = this->get_tower_allocation();
+                            auto [ columns , rows ] = this->get_browser_layout();
+                            std::int64_t column = x*static_cast<std::int64_t>( columns )/std::max( allocation.get_width() , 1 );
+                            std::int64_t row = y*static_cast<std::int64_t>( rows )/std::max( allocation.get_height() , 1 );
+                            this->select_browser_floor( row*columns + column );
+                            this->close_floor_browser( true );
+                            break;
+                        }
                         case GAME_STATE::GAME_LOSE:
                         case GAME_STATE::GAME_WIN:
                         {
@@ -1177,25 +2292,67 @@ namespace MagicTower
 
         bool exit_game( GdkEventAny * )
         {
-            this->main_loop.quit();
+            this->main_loop->quit();
             return true;
         }
 
     private:
+        std::int64_t startup_time;
         GameStatus * game_status;
-        Gtk::Main main_loop;
+        std::unique_ptr<Gtk::Main> main_loop;
         Pango::FontDescription font_desc;
         Glib::RefPtr<Pango::Layout> layout;
+        TextCache text_cache;
+        FrameMetrics metrics;
+        Glib::RefPtr<Pango::Layout> metrics_layout;
+        SpriteCache sprite_cache;
+        TileCache tile_cache;
+        BandRasterizer band_rasterizer;
+        VisionMask vision_mask;
+        ThumbnailCache thumbnail_cache;
         sigc::connection findpath_connection;
         sigc::connection draw_connection;
         Gtk::Window * window;
         Gtk::DrawingArea * game_area;
         Gtk::DrawingArea * info_area;
-        std::map<std::string,Glib::RefPtr<Gdk::Pixbuf>> image_resource;
-        Glib::RefPtr<Gdk::Pixbuf> info_frame;
+        std::map<std::uint32_t,FloorLayer> floor_layers;
+        Cairo::RefPtr<Cairo::ImageSurface> info_frame;
+        std::uint64_t info_frame_generation = 0;
+        InfoPanel info_panel;
+        std::optional<std::uint32_t> prefetched_floor;
+        //floor id -> ( TowerFloor::generation , distinct images of the floor )
+        std::map<std::uint32_t , std::pair<std::uint64_t , std::set<std::string>>> floor_images;
+        bool first_frame_drawn = false;
+        bool startup_decode_logged = false;
+        //size of displayed sprites,follow sprite cache
         std::uint32_t pixel_size = 32;
+        std::uint32_t scale_factor = 1;
+        //last size from allocation,rescale may still in progress
+        std::uint32_t requested_pixel_size = 0;
+        std::uint32_t requested_scale = 0;
         std::uint32_t click_x = 0;
         std::uint32_t click_y = 0;
+        //camera:top left corner of viewport in floor pixel coordinate
+        double camera_x = 0;
+        double camera_y = 0;
+        std::optional<std::uint32_t> camera_floor;
+        std::uint32_t camera_pixel_size = 0;
+        bool camera_ticking = false;
+        std::int64_t camera_frame_time = 0;
+        std::uint64_t frame_count = 0;
+        //animation clock:frame clock time/animation_frame_interval
+        std::uint64_t animation_frame = 0;
+        bool animation_visible = false;
+        bool animation_ticking = false;
+        bool show_minimap = false;
+        bool show_metrics = false;
+        //floor selected in browser,the jump menu preview floor( hero.floors ) change only on confirm
+        std::optional<std::uint32_t> browser_floor;
+        //offscreen mode area size
+        int offscreen_tower_width = 0;
+        int offscreen_info_width = 0;
+        int offscreen_height = 0;
+        //grid count at least displayed along the viewport axis,decide the grid size
         std::uint8_t max_grid_x = 10;
         std::uint8_t max_grid_y = 10;
     };
@@ -1212,4 +2369,13 @@ namespace MagicTower
     {
         imp_ptr->run();
     }
+    int GameWindow::render_offscreen( const std::string& output_dir , int width , int height )
+    {
+        //no Gtk::Main,initial the wrappers used by draw code
+        Glib::init();
+        Gio::init();
+        Pango::init();
+        GameWindowImp imp( std::make_pair( width , height ) );
+        return imp.render_offscreen( output_dir );
+    }
 }
@@ -14,6 +14,9 @@ namespace MagicTower
         GameWindow();
         ~GameWindow();
         void run();
+        //render every floor through the draw handlers into png,no display required.
+        //width,height:offscreen size of tower area + info area
+        static int render_offscreen( const std::string& output_dir , int width , int height );
 
         GameWindow( const GameWindow& rhs )=delete;
         GameWindow( GameWindow&& rhs )=delete;
@@ -0,0 +1,149 @@
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <glib.h>
+
+#include "metrics.h"
+
+namespace MagicTower
+{
+    SampleRing::SampleRing( std::size_t capacity ):
+        values( std::max<std::size_t>( capacity , 1 ) , 0.0 ),
+        next( 0 ),
+        count( 0 )
+    {
+    }
+
+    void SampleRing::push( double value )
+    {
+        this->values[ this->next ] = value;
+        this->next = ( this->next + 1 )%this->values.size();
+        this->count = std::min( this->count + 1 , this->values.size() );
+    }
+
+    std::size_t SampleRing::size( void ) const
+    {
+        return this->count;
+    }
+
+    double SampleRing::percentile( double percent ) const
+    {
+        if ( this->count == 0 )
+            return 0;
+        std::vector<double> sorted = this->samples();
+        std::size_t rank = static_cast<std::size_t>( std::clamp( percent , 0.0 , 100.0 )/100.0*( sorted.size() - 1 ) + 0.5 );
+        std::nth_element( sorted.begin() , sorted.begin() + rank , sorted.end() );
+        return sorted[ rank ];
+    }
+
+    double SampleRing::mean( void ) const
+    {
+        if ( this->count == 0 )
+            return 0;
+        double sum = 0;
+        for ( std::size_t i = 0 ; i < this->count ; i++ )
+            sum += this->values[i];
+        return sum/this->count;
+    }
+
+    std::vector<double> SampleRing::samples( void ) const
+    {
+        std::vector<double> result;
+        result.reserve( this->count );
+        std::size_t capacity = this->values.size();
+        std::size_t first = ( this->next + capacity - this->count )%capacity;
+        for ( std::size_t i = 0 ; i < this->count ; i++ )
+            result.push_back( this->values[ ( first + i )%capacity ] );
+        return result;
+    }
+
+    FrameMetrics::FrameMetrics():
+        series(),
+        last_frame_time( 0 ),
+        key_pending( false ),
+        key_event_time( 0 ),
+        key_receive_time( 0 )
+    {
+    }
+
+    void FrameMetrics::record( const std::string& series_name , double milliseconds )
+    {
+        this->series[ series_name ].push( milliseconds );
+    }
+
+    void FrameMetrics::frame_presented( std::int64_t frame_time )
+    {
+        if ( this->last_frame_time != 0 && frame_time > this->last_frame_time )
+            this->record( "frame_interval" , ( frame_time - this->last_frame_time )/1000.0 );
+        this->last_frame_time = frame_time;
+
+        if ( !this->key_pending )
+            return ;
+        this->key_pending = false;
+        //X11 server time and wayland event time are CLOCK_MONOTONIC millisecond on linux,
+        //other backend use another clock,the wrapped difference out of range fall back to the receive time
+        std::uint32_t event_latency = static_cast<std::uint32_t>( frame_time/1000 ) - this->key_event_time;
+        if ( this->key_event_time != 0 && event_latency < 10000 )
+            this->record( "key_to_frame" , event_latency );
+        else
+            this->record( "key_to_frame" , std::max<std::int64_t>( frame_time - this->key_receive_time , 0 )/1000.0 );
+    }
+
+    void FrameMetrics::key_pressed( std::uint32_t event_time )
+    {
+        //only the first key before a frame count,the frame answer it
+        if ( this->key_pending )
+            return ;
+        this->key_pending = true;
+        this->key_event_time = event_time;
+        this->key_receive_time = g_get_monotonic_time();
+    }
+
+    double FrameMetrics::get_fps( void ) const
+    {
+        auto iter = this->series.find( "frame_interval" );
+        if ( iter == this->series.end() )
+            return 0;
+        double interval = iter->second.mean();
+        return interval > 0 ? 1000.0/interval : 0;
+    }
+
+    const std::map<std::string,SampleRing>& FrameMetrics::get_series( void ) const
+    {
+        return this->series;
+    }
+
+    std::string FrameMetrics::to_csv( void ) const
+    {
+        std::string csv( "series,sample,milliseconds\n" );
+        for ( auto& [ name , ring ] : this->series )
+        {
+            std::vector<double> values = ring.samples();
+            for ( std::size_t i = 0 ; i < values.size() ; i++ )
+            {
+                char value_buffer[G_ASCII_DTOSTR_BUF_SIZE];
+                //locale independent decimal point
+                g_ascii_formatd( value_buffer , sizeof( value_buffer ) , "%.3f" , values[i] );
+                csv += name + "," + std::to_string( i ) + "," + value_buffer + "\n";
+            }
+        }
+        return csv;
+    }
+
+    ScopedTimer::ScopedTimer( FrameMetrics& _metrics , const char * _series ):
+        metrics( _metrics ),
+        series( _series ),
+        start_time( g_get_monotonic_time() )
+    {
+    }
+
+    ScopedTimer::~ScopedTimer()
+    {
+        this->metrics.record( this->series , ( g_get_monotonic_time() - this->start_time )/1000.0 );
+    }
+}
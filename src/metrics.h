@@ -0,0 +1,82 @@
+#pragma once
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace MagicTower
+{
+    //fixed capacity sample window,oldest sample overwritten first
+    class SampleRing
+    {
+    public:
+        SampleRing( std::size_t capacity = 600 );
+
+        void push( double value );
+        std::size_t size( void ) const;
+        //percent range [0,100],0 if empty
+        double percentile( double percent ) const;
+        double mean( void ) const;
+        //oldest first
+        std::vector<double> samples( void ) const;
+    private:
+        std::vector<double> values;
+        std::size_t next;
+        std::size_t count;
+    };
+
+    //frame timing and input latency store,main thread only.
+    //series are keyed by name and keep the recent samples in milliseconds
+    class FrameMetrics
+    {
+    public:
+        FrameMetrics();
+
+        void record( const std::string& series , double milliseconds );
+        //frame_time:frame clock time in microsecond,monotonic
+        void frame_presented( std::int64_t frame_time );
+        //event_time:GdkEvent timestamp in millisecond
+        void key_pressed( std::uint32_t event_time );
+
+        double get_fps( void ) const;
+        const std::map<std::string,SampleRing>& get_series( void ) const;
+        //series,sample,milliseconds
+        std::string to_csv( void ) const;
+
+        FrameMetrics( const FrameMetrics& rhs )=delete;
+        FrameMetrics( FrameMetrics&& rhs )=delete;
+        FrameMetrics& operator=( const FrameMetrics& rhs )=delete;
+        FrameMetrics& operator=( FrameMetrics&& rhs )=delete;
+    private:
+        std::map<std::string,SampleRing> series;
+        std::int64_t last_frame_time;
+        //key press wait for the next frame
+        bool key_pending;
+        std::uint32_t key_event_time;
+        std::int64_t key_receive_time;
+    };
+
+    //record the elapsed time of the scope
+    class ScopedTimer
+    {
+    public:
+        ScopedTimer( FrameMetrics& metrics , const char * series );
+        ~ScopedTimer();
+
+        ScopedTimer( const ScopedTimer& rhs )=delete;
+        ScopedTimer( ScopedTimer&& rhs )=delete;
+        ScopedTimer& operator=( const ScopedTimer& rhs )=delete;
+        ScopedTimer& operator=( ScopedTimer&& rhs )=delete;
+    private:
+        FrameMetrics& metrics;
+        const char * series;
+        std::int64_t start_time;
+    };
+}
+
+#endif
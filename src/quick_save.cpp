@@ -0,0 +1,55 @@
+#include <cstddef>
+#include <cstdint>
+
+#include <deque>
+#include <utility>
+
+#include "quick_save.h"
+#include "tower.h"
+
+namespace MagicTower
+{
+    QuickSaveRing::QuickSaveRing( std::size_t _capacity ):
+        capacity( _capacity > 0 ? _capacity : 1 ),
+        snapshots()
+    {
+    }
+
+    void QuickSaveRing::push( QuickSnapshot snapshot )
+    {
+        if ( this->snapshots.size() >= this->capacity )
+            this->snapshots.pop_back();
+        this->snapshots.push_front( std::move( snapshot ) );
+    }
+
+    const QuickSnapshot * QuickSaveRing::get( std::size_t age ) const
+    {
+        if ( age >= this->snapshots.size() )
+            return nullptr;
+        return &( this->snapshots[ age ] );
+    }
+
+    std::size_t QuickSaveRing::size( void ) const
+    {
+        return this->snapshots.size();
+    }
+
+    void QuickSaveRing::restore_tower( TowerMap& tower , const TowerSnapshot& snapshot )
+    {
+        for ( auto iter = tower.map.begin() ; iter != tower.map.end() ; )
+        {
+            if ( snapshot.find( iter->first ) == snapshot.end() )
+                iter = tower.map.erase( iter );
+            else
+                iter++;
+        }
+        for ( auto& [ floor_id , floor ] : snapshot )
+        {
+            auto floor_iter = tower.map.find( floor_id );
+            //same generation,same content
+            if ( floor_iter != tower.map.end() && floor_iter->second.generation == floor->generation )
+                continue;
+            tower.map[ floor_id ] = *floor;
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+#ifndef QUICK_SAVE_H
+#define QUICK_SAVE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <deque>
+#include <map>
+#include <string>
+
+#include "hero.h"
+#include "tower.h"
+
+namespace MagicTower
+{
+    //game state of one quicksave,floors shared with other snapshots and pending saves
+    struct QuickSnapshot
+    {
+        TowerSnapshot tower;
+        Hero hero;
+        std::map<std::string , std::uint32_t> script_flags;
+        std::map<std::uint32_t , std::uint32_t> inventories;
+        //store id -> usability
+        std::map<std::uint32_t , bool> store_usability;
+        std::map<std::uint32_t , bool> access_floor;
+        //second
+        std::int64_t play_time;
+    };
+
+    //last capacity quicksaves in memory,main thread only.
+    //capture copy the floors changed since last snapshot only,restore copy the floors differ from current tower only
+    class QuickSaveRing
+    {
+    public:
+        QuickSaveRing( std::size_t capacity = 8 );
+
+        //drop the oldest when full
+        void push( QuickSnapshot snapshot );
+        //age 0 is newest,nullptr if out of ring
+        const QuickSnapshot * get( std::size_t age ) const;
+        std::size_t size( void ) const;
+        //floors whose generation equal to snapshot are kept,generation of restored floors is the snapshot one
+        static void restore_tower( TowerMap& tower , const TowerSnapshot& snapshot );
+    private:
+        std::size_t capacity;
+        std::deque<QuickSnapshot> snapshots;
+    };
+}
+
+#endif
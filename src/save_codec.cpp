@@ -0,0 +1,188 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "tower.h"
+#include "save_codec.h"
+
+namespace MagicTower
+{
+    static const std::uint8_t delta_magic[3] = { 'M' , 'T' , 'D' };
+    static const std::uint8_t codec_version = 1;
+    //magic,version and checksum
+    static const std::size_t header_size = 4;
+    static const std::size_t checksum_size = 4;
+
+    struct BlobReader
+    {
+        const std::uint8_t * data;
+        //end of body,checksum excluded
+        std::size_t size;
+        std::size_t offset;
+    };
+
+    static std::uint32_t blob_checksum( const std::uint8_t * data , std::size_t size )
+    {
+        std::uint32_t hash = 2166136261u;
+        for ( std::size_t i = 0 ; i < size ; i++ )
+        {
+            hash ^= data[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    static void put_varint( std::vector<std::uint8_t>& blob , std::uint64_t value )
+    {
+        while ( value >= 0x80 )
+        {
+            blob.push_back( static_cast<std::uint8_t>( value | 0x80 ) );
+            value >>= 7;
+        }
+        blob.push_back( static_cast<std::uint8_t>( value ) );
+    }
+
+    static std::uint64_t get_varint( BlobReader& reader )
+    {
+        std::uint64_t value = 0;
+        for ( unsigned int shift = 0 ; shift < 64 ; shift += 7 )
+        {
+            if ( reader.offset >= reader.size )
+                throw std::runtime_error( std::string( "archive blob truncated" ) );
+            std::uint8_t byte = reader.data[ reader.offset++ ];
+            value |= static_cast<std::uint64_t>( byte & 0x7F ) << shift;
+            if ( ( byte & 0x80 ) == 0 )
+                return value;
+        }
+        throw std::runtime_error( std::string( "archive blob varint too long" ) );
+    }
+
+    static std::uint32_t get_uint32( BlobReader& reader )
+    {
+        std::uint64_t value = get_varint( reader );
+        if ( value > std::numeric_limits<std::uint32_t>::max() )
+            throw std::runtime_error( std::string( "archive blob value out of range" ) );
+        return static_cast<std::uint32_t>( value );
+    }
+
+    static void put_header( std::vector<std::uint8_t>& blob , const std::uint8_t ( &magic )[3] )
+    {
+        for ( std::uint8_t byte : magic )
+        {
+            blob.push_back( byte );
+        }
+        blob.push_back( codec_version );
+    }
+
+    static void put_checksum( std::vector<std::uint8_t>& blob )
+    {
+        std::uint32_t checksum = blob_checksum( blob.data() , blob.size() );
+        for ( int i = 0 ; i < 4 ; i++ )
+        {
+            blob.push_back( static_cast<std::uint8_t>( checksum >> ( 8*i ) ) );
+        }
+    }
+
+    static bool has_magic( const std::uint8_t * data , std::size_t size , const std::uint8_t ( &magic )[3] )
+    {
+        return size >= header_size && std::memcmp( data , magic , 3 ) == 0;
+    }
+
+    //check version and checksum,the reader cover the body
+    static BlobReader open_blob( const std::uint8_t * data , std::size_t size )
+    {
+        if ( size < header_size + checksum_size )
+            throw std::runtime_error( std::string( "archive blob size:" ) + std::to_string( size ) + std::string( " too small" ) );
+        if ( data[3] != codec_version )
+            throw std::runtime_error( std::string( "archive blob version:" ) + std::to_string( data[3] ) + std::string( " unsupported" ) );
+        std::size_t body_end = size - checksum_size;
+        std::uint32_t checksum = 0;
+        for ( int i = 0 ; i < 4 ; i++ )
+        {
+            checksum |= static_cast<std::uint32_t>( data[ body_end + i ] ) << ( 8*i );
+        }
+        if ( checksum != blob_checksum( data , body_end ) )
+            throw std::runtime_error( std::string( "archive blob checksum mismatch" ) );
+        return { data , body_end , header_size };
+    }
+
+    static TowerGrid get_grid( BlobReader& reader )
+    {
+        std::uint32_t type = get_uint32( reader );
+        if ( type > static_cast<std::uint32_t>( GRID_TYPE::UNKNOWN ) )
+            throw std::runtime_error( std::string( "archive blob grid type:" ) + std::to_string( type ) + std::string( " unknown" ) );
+        std::uint32_t id = get_uint32( reader );
+        return { static_cast<GRID_TYPE>( type ) , id };
+    }
+
+    std::vector<TowerGrid> decode_floor_content( const void * data , std::size_t size , std::size_t grid_count )
+    {
+        if ( size != grid_count*sizeof( TowerGrid ) )
+            throw std::runtime_error( std::string( "floor content size:" ) + std::to_string( size ) +
+                std::string( " expect:" ) + std::to_string( grid_count*sizeof( TowerGrid ) ) );
+        std::vector<TowerGrid> content( grid_count );
+        if ( size > 0 )
+            std::memcpy( content.data() , data , size );
+        return content;
+    }
+
+    std::vector<std::uint8_t> encode_tower_delta( const TowerDelta& delta )
+    {
+        std::vector<std::uint8_t> blob;
+        blob.reserve( header_size + checksum_size + 1 + delta.size()*4 );
+        put_header( blob , delta_magic );
+        put_varint( blob , delta.size() );
+        std::uint32_t floor_id = 0;
+        std::uint32_t index = 0;
+        for ( const GridDelta& grid_delta : delta )
+        {
+            put_varint( blob , grid_delta.floor_id - floor_id );
+            if ( grid_delta.floor_id != floor_id )
+                index = 0;
+            put_varint( blob , grid_delta.index - index );
+            put_varint( blob , static_cast<std::uint32_t>( grid_delta.grid.type ) );
+            put_varint( blob , grid_delta.grid.id );
+            floor_id = grid_delta.floor_id;
+            index = grid_delta.index;
+        }
+        put_checksum( blob );
+        return blob;
+    }
+
+    TowerDelta decode_tower_delta( const void * data , std::size_t size )
+    {
+        const std::uint8_t * bytes = static_cast<const std::uint8_t *>( data );
+        if ( !has_magic( bytes , size , delta_magic ) )
+            throw std::runtime_error( std::string( "tower delta magic mismatch" ) );
+
+        BlobReader reader = open_blob( bytes , size );
+        std::uint64_t count = get_varint( reader );
+        //every entry take 4 byte at least,don't trust the count for reserve
+        if ( count > ( reader.size - reader.offset )/4 )
+            throw std::runtime_error( std::string( "tower delta count:" ) + std::to_string( count ) + std::string( " broken" ) );
+        TowerDelta delta;
+        delta.reserve( count );
+        std::uint64_t floor_id = 0;
+        std::uint64_t index = 0;
+        for ( std::uint64_t i = 0 ; i < count ; i++ )
+        {
+            std::uint64_t floor_step = get_uint32( reader );
+            if ( floor_step != 0 )
+                index = 0;
+            floor_id += floor_step;
+            index += get_uint32( reader );
+            if ( floor_id > std::numeric_limits<std::uint32_t>::max() || index > std::numeric_limits<std::uint32_t>::max() )
+                throw std::runtime_error( std::string( "tower delta position out of range" ) );
+            TowerGrid grid = get_grid( reader );
+            delta.push_back( { static_cast<std::uint32_t>( floor_id ) , static_cast<std::uint32_t>( index ) , grid } );
+        }
+        if ( reader.offset != reader.size )
+            throw std::runtime_error( std::string( "tower delta trailing data" ) );
+        return delta;
+    }
+}
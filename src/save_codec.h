@@ -0,0 +1,27 @@
+#pragma once
+#ifndef SAVE_CODEC_H
+#define SAVE_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+#include "tower.h"
+
+namespace MagicTower
+{
+    //archive blob encoding,independent of struct layout and byte order.
+    //blob:magic(3 byte),version(1 byte),varint body,FNV-1a 32 checksum of the bytes before it(4 byte,little endian).
+    //delta body:entry count,then ( floor id step , index step , type , id ),index step restart on new floor.
+    //decode check every length and throw std::runtime_error on broken blob
+
+    //full floor row of gamedata and old archive,raw TowerGrid array.grid_count:length*width of the row
+    std::vector<TowerGrid> decode_floor_content( const void * data , std::size_t size , std::size_t grid_count );
+
+    //delta must be sorted by ( floor_id , index ),as diff_floor in floor id order make
+    std::vector<std::uint8_t> encode_tower_delta( const TowerDelta& delta );
+    TowerDelta decode_tower_delta( const void * data , std::size_t size );
+}
+
+#endif
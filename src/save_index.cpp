@@ -0,0 +1,170 @@
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "database.h"
+#include "hero.h"
+#include "save_index.h"
+#include "tower.h"
+
+namespace MagicTower
+{
+    //larger floor get no thumbnail,keep the row small
+    static const std::size_t thumbnail_max_grids = 64*64;
+
+    SaveIndex::SaveIndex( std::string filename ):
+        db_handler( nullptr ),
+        select_statement(),
+        replace_statement()
+    {
+        int error_code = sqlite3_open_v2( filename.c_str() , &( this->db_handler ) , SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE , nullptr );
+        if ( error_code != SQLITE_OK )
+        {
+            sqlite3_close( this->db_handler );
+            throw std::runtime_error( std::string( "open file:" ) + filename + std::string( " failure,slite3 error code:" ) + std::to_string( error_code ) );
+        }
+        sqlite3_exec( this->db_handler , "PRAGMA journal_mode = WAL" , nullptr , nullptr , nullptr );
+        sqlite3_exec( this->db_handler , R"(
+            CREATE TABLE IF NOT EXISTS save_slots (
+                slot_id             INTEGER  PRIMARY KEY,
+                timestamp           INT (64),
+                play_time           INT (64),
+                floor_id            INT (32),
+                floor_name          TEXT,
+                level               INT (32),
+                life                INT (32),
+                attack              INT (32),
+                defense             INT (32),
+                gold                INT (32),
+                thumbnail_length    INT (32),
+                thumbnail_width     INT (32),
+                thumbnail           BLOB
+            );
+        )" , nullptr , nullptr , nullptr );
+        try
+        {
+            this->select_statement = std::make_unique<SqlStatement>( this->db_handler , "SELECT slot_id,timestamp,play_time,floor_id,floor_name,"
+                "level,life,attack,defense,gold,thumbnail_length,thumbnail_width,thumbnail FROM save_slots" );
+            this->replace_statement = std::make_unique<SqlStatement>( this->db_handler , "INSERT OR REPLACE INTO save_slots(slot_id,timestamp,play_time,"
+                "floor_id,floor_name,level,life,attack,defense,gold,thumbnail_length,thumbnail_width,thumbnail) "
+                "VALUES( ? , ? , ? , ? , ? , ? , ? , ? , ? , ? , ? , ? , ? )" );
+        }
+        catch ( ... )
+        {
+            this->select_statement.reset();
+            sqlite3_close( this->db_handler );
+            throw ;
+        }
+    }
+
+    SaveIndex::~SaveIndex()
+    {
+        //statement must be finalized before close
+        this->select_statement.reset();
+        this->replace_statement.reset();
+        sqlite3_close( this->db_handler );
+    }
+
+    std::map<std::size_t,SaveSlotInfo> SaveIndex::get_slots( void )
+    {
+        ScopedStatement statement( *( this->select_statement ) );
+        sqlite3_stmt * statement_handler = statement.get();
+
+        std::map<std::size_t,SaveSlotInfo> slots;
+        int error_code = SQLITE_OK;
+        while ( ( error_code = sqlite3_step( statement_handler ) ) == SQLITE_ROW )
+        {
+            SaveSlotInfo info;
+            info.slot_id = sqlite3_column_int64( statement_handler , 0 );
+            info.timestamp = sqlite3_column_int64( statement_handler , 1 );
+            info.play_time = sqlite3_column_int64( statement_handler , 2 );
+            info.floor_id = sqlite3_column_int( statement_handler , 3 );
+            const unsigned char * floor_name = sqlite3_column_text( statement_handler , 4 );
+            info.floor_name = ( floor_name != nullptr ) ? std::string( reinterpret_cast<const char *>( floor_name ) ) : std::string();
+            info.level = sqlite3_column_int( statement_handler , 5 );
+            info.life = sqlite3_column_int( statement_handler , 6 );
+            info.attack = sqlite3_column_int( statement_handler , 7 );
+            info.defense = sqlite3_column_int( statement_handler , 8 );
+            info.gold = sqlite3_column_int( statement_handler , 9 );
+            info.thumbnail_length = sqlite3_column_int( statement_handler , 10 );
+            info.thumbnail_width = sqlite3_column_int( statement_handler , 11 );
+            const std::uint8_t * thumbnail = static_cast<const std::uint8_t *>( sqlite3_column_blob( statement_handler , 12 ) );
+            std::size_t thumbnail_size = sqlite3_column_bytes( statement_handler , 12 );
+            //a broken thumbnail only lose the preview
+            if ( thumbnail != nullptr && thumbnail_size == static_cast<std::size_t>( info.thumbnail_length )*info.thumbnail_width )
+                info.thumbnail.assign( thumbnail , thumbnail + thumbnail_size );
+            else
+                info.thumbnail_length = info.thumbnail_width = 0;
+            slots[ info.slot_id ] = std::move( info );
+        }
+        if ( error_code != SQLITE_DONE )
+        {
+            throw std::runtime_error( std::string( "evaluate statement:SELECT FROM save_slots failure,slite3 error code:" ) + std::to_string( error_code ) );
+        }
+        return slots;
+    }
+
+    void SaveIndex::set_slot( const SaveSlotInfo& info )
+    {
+        ScopedStatement statement( *( this->replace_statement ) );
+        sqlite3_stmt * statement_handler = statement.get();
+        sqlite3_bind_int64( statement_handler , 1 , static_cast<sqlite3_int64>( info.slot_id ) );
+        sqlite3_bind_int64( statement_handler , 2 , info.timestamp );
+        sqlite3_bind_int64( statement_handler , 3 , info.play_time );
+        sqlite3_bind_int( statement_handler , 4 , info.floor_id );
+        sqlite3_bind_text( statement_handler , 5 , info.floor_name.c_str() , info.floor_name.size() , SQLITE_STATIC );
+        sqlite3_bind_int( statement_handler , 6 , info.level );
+        sqlite3_bind_int( statement_handler , 7 , info.life );
+        sqlite3_bind_int( statement_handler , 8 , info.attack );
+        sqlite3_bind_int( statement_handler , 9 , info.defense );
+        sqlite3_bind_int( statement_handler , 10 , info.gold );
+        sqlite3_bind_int( statement_handler , 11 , info.thumbnail_length );
+        sqlite3_bind_int( statement_handler , 12 , info.thumbnail_width );
+        //zero length blob instead of NULL for no thumbnail
+        sqlite3_bind_blob( statement_handler , 13 , info.thumbnail.empty() ? "" : static_cast<const void *>( info.thumbnail.data() ) ,
+            info.thumbnail.size() , SQLITE_STATIC );
+        int error_code = sqlite3_step( statement_handler );
+        if ( error_code != SQLITE_DONE )
+        {
+            throw std::runtime_error( std::string( "evaluate statement:INSERT INTO save_slots failure,slite3 error code:" ) + std::to_string( error_code ) );
+        }
+    }
+
+    SaveSlotInfo SaveIndex::make_slot_info( std::size_t slot_id , const TowerMap& tower , const Hero& hero , std::int64_t play_time )
+    {
+        SaveSlotInfo info = {};
+        info.slot_id = slot_id;
+        info.timestamp = static_cast<std::int64_t>( std::time( nullptr ) );
+        info.play_time = play_time;
+        info.floor_id = hero.floors;
+        info.level = hero.level;
+        info.life = hero.life;
+        info.attack = hero.attack;
+        info.defense = hero.defense;
+        info.gold = hero.gold;
+        auto floor_iter = tower.map.find( hero.floors );
+        if ( floor_iter == tower.map.end() )
+            return info;
+        const TowerFloor& floor = floor_iter->second;
+        info.floor_name = floor.name;
+        std::size_t grid_count = static_cast<std::size_t>( floor.length )*floor.width;
+        if ( grid_count == 0 || grid_count > thumbnail_max_grids || floor.content.size() < grid_count )
+            return info;
+        info.thumbnail_length = floor.length;
+        info.thumbnail_width = floor.width;
+        info.thumbnail.resize( grid_count );
+        for ( std::size_t i = 0 ; i < grid_count ; i++ )
+        {
+            info.thumbnail[i] = static_cast<std::uint8_t>( floor.content[i].type );
+        }
+        return info;
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+#ifndef SAVE_INDEX_H
+#define SAVE_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include "database.h"
+#include "hero.h"
+#include "tower.h"
+
+namespace MagicTower
+{
+    /* CREATE TABLE save_slots (
+        slot_id             INTEGER  PRIMARY KEY,
+        timestamp           INT (64),
+        play_time           INT (64),
+        floor_id            INT (32),
+        floor_name          TEXT,
+        level               INT (32),
+        life                INT (32),
+        attack              INT (32),
+        defense             INT (32),
+        gold                INT (32),
+        thumbnail_length    INT (32),
+        thumbnail_width     INT (32),
+        thumbnail           BLOB
+    );
+     */
+    struct SaveSlotInfo
+    {
+        std::size_t slot_id;
+        //unix time,second
+        std::int64_t timestamp;
+        //second
+        std::int64_t play_time;
+        std::uint32_t floor_id;
+        std::string floor_name;
+        std::uint32_t level;
+        std::uint32_t life;
+        std::uint32_t attack;
+        std::uint32_t defense;
+        std::uint32_t gold;
+        //GRID_TYPE of every grid of the hero floor,empty if the floor too large
+        std::uint32_t thumbnail_length;
+        std::uint32_t thumbnail_width;
+        std::vector<std::uint8_t> thumbnail;
+    };
+
+    //metadata of every save slot in one database( <save path>/index.db ),
+    //the save menu list the slots without open any archive
+    class SaveIndex
+    {
+    public:
+        //throw std::runtime_error if open failure
+        SaveIndex( std::string filename );
+        ~SaveIndex();
+
+        std::map<std::size_t,SaveSlotInfo> get_slots( void );
+        //replace the row of slot in one statement,all or nothing
+        void set_slot( const SaveSlotInfo& info );
+        //timestamp is now
+        static SaveSlotInfo make_slot_info( std::size_t slot_id , const TowerMap& tower , const Hero& hero , std::int64_t play_time );
+
+        SaveIndex( const SaveIndex& )=delete;
+        SaveIndex( SaveIndex&& )=delete;
+        SaveIndex& operator=( const SaveIndex& )=delete;
+        SaveIndex& operator=( SaveIndex&& )=delete;
+    private:
+        sqlite3 * db_handler;
+        std::unique_ptr<SqlStatement> select_statement;
+        std::unique_ptr<SqlStatement> replace_statement;
+    };
+}
+
+#endif
@@ -0,0 +1,370 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glibmm.h>
+
+#include "database.h"
+#include "resources.h"
+#include "save_index.h"
+#include "save_service.h"
+
+namespace MagicTower
+{
+    SaveService::SaveService():
+        floor_cache(),
+        baseline(),
+        baseline_hash( 0 ),
+        slot_infos(),
+        floor_deltas(),
+        floor_deltas_hash( 0 ),
+        database_mutex(),
+        databases(),
+        written_archives(),
+        index(),
+        job_mutex(),
+        job_condition(),
+        idle_condition(),
+        jobs(),
+        results(),
+        stored_slots(),
+        index_error(),
+        busy( false ),
+        stop( false ),
+        dispatcher(),
+        worker()
+    {
+        this->dispatcher.connect( sigc::mem_fun( *this , &SaveService::upload_results ) );
+        this->worker = std::thread( &SaveService::worker_loop , this );
+    }
+
+    SaveService::~SaveService()
+    {
+        {
+            std::lock_guard<std::mutex> lock( this->job_mutex );
+            this->stop = true;
+        }
+        this->job_condition.notify_all();
+        this->worker.join();
+    }
+
+    void SaveService::save( std::size_t save_id , const TowerMap& tower , const Hero& hero ,
+        const std::map<std::string , std::uint32_t>& flags , const std::map<std::uint32_t , std::uint32_t>& inventories ,
+        std::int64_t play_time , SaveCallback done )
+    {
+        this->submit( save_id , tower , hero , flags , inventories , play_time , false , std::move( done ) );
+    }
+
+    void SaveService::save_replace( std::size_t save_id , const TowerMap& tower , const Hero& hero ,
+        const std::map<std::string , std::uint32_t>& flags , const std::map<std::uint32_t , std::uint32_t>& inventories ,
+        std::int64_t play_time , SaveCallback done )
+    {
+        this->submit( save_id , tower , hero , flags , inventories , play_time , true , std::move( done ) );
+    }
+
+    void SaveService::submit( std::size_t save_id , const TowerMap& tower , const Hero& hero ,
+        const std::map<std::string , std::uint32_t>& flags , const std::map<std::uint32_t , std::uint32_t>& inventories ,
+        std::int64_t play_time , bool replace , SaveCallback done )
+    {
+        SaveJob job = { save_id , this->baseline , this->baseline_hash , this->snapshot_tower( tower ) , hero , flags , inventories ,
+            SaveIndex::make_slot_info( save_id , tower , hero , play_time ) , replace , std::move( done ) };
+        {
+            std::lock_guard<std::mutex> lock( this->job_mutex );
+            this->jobs.push_back( std::move( job ) );
+        }
+        this->job_condition.notify_one();
+    }
+
+    void SaveService::set_baseline( const TowerMap& tower )
+    {
+        this->baseline.clear();
+        for ( auto& [ floor_id , floor ] : tower.map )
+        {
+            this->baseline[ floor_id ] = std::make_shared<const TowerFloor>( floor );
+        }
+        this->baseline_hash = hash_tower( this->baseline );
+        //the game map floors share generation with baseline,reuse the copies
+        this->floor_cache = this->baseline;
+    }
+
+    TowerMap SaveService::get_baseline( void ) const
+    {
+        TowerMap tower;
+        for ( auto& [ floor_id , floor ] : this->baseline )
+        {
+            tower.map[ floor_id ] = *floor;
+        }
+        return tower;
+    }
+
+    std::uint64_t SaveService::get_baseline_hash( void ) const
+    {
+        return this->baseline_hash;
+    }
+
+    void SaveService::read( std::size_t save_id , const std::function<void( DataBase& )>& reader )
+    {
+        {
+            std::unique_lock<std::mutex> lock( this->job_mutex );
+            this->idle_condition.wait( lock , [ this ](){ return this->jobs.empty() && !this->busy; } );
+        }
+        std::lock_guard<std::mutex> lock( this->database_mutex );
+        reader( this->get_database( save_id ) );
+    }
+
+    bool SaveService::has_pending( void )
+    {
+        std::lock_guard<std::mutex> lock( this->job_mutex );
+        return !this->jobs.empty() || this->busy;
+    }
+
+    const std::map<std::size_t,SaveSlotInfo>& SaveService::get_slots( void )
+    {
+        return this->slot_infos;
+    }
+
+    TowerSnapshot SaveService::snapshot_tower( const TowerMap& tower )
+    {
+        TowerSnapshot snapshot;
+        for ( auto& [ floor_id , floor ] : tower.map )
+        {
+            std::shared_ptr<const TowerFloor>& cached = this->floor_cache[ floor_id ];
+            //generation equal:the shared copy is still the floor
+            if ( !cached || cached->generation != floor.generation )
+                cached = std::make_shared<const TowerFloor>( floor );
+            snapshot[ floor_id ] = cached;
+        }
+        for ( auto iter = this->floor_cache.begin() ; iter != this->floor_cache.end() ; )
+        {
+            if ( tower.map.find( iter->first ) == tower.map.end() )
+                iter = this->floor_cache.erase( iter );
+            else
+                iter++;
+        }
+        return snapshot;
+    }
+
+    DataBase& SaveService::get_database( std::size_t save_id )
+    {
+        std::unique_ptr<DataBase>& database = this->databases[ save_id ];
+        if ( !database )
+        {
+            database = std::make_unique<DataBase>( ResourcesManager::get_save_path() + std::to_string( save_id ) + std::string( ".db" ) );
+        }
+        return *database;
+    }
+
+    void SaveService::replace_archive( const SaveJob& job , const TowerDelta& delta )
+    {
+        std::string archive_path = ResourcesManager::get_save_path() + std::to_string( job.save_id ) + std::string( ".db" );
+        std::string temp_path = archive_path + std::string( ".tmp" );
+        //left by a crash during last write
+        for ( const char * suffix : { "" , "-wal" , "-shm" } )
+        {
+            std::remove( ( temp_path + suffix ).c_str() );
+        }
+        {
+            //closed before rename,the last close checkpoint the log into the file
+            DataBase temp_database( temp_path );
+            temp_database.save_snapshot( delta , job.baseline_hash , get_generations( job.tower ) , job.hero , job.flags , job.inventories );
+        }
+
+        std::lock_guard<std::mutex> lock( this->database_mutex );
+        //a cached connection would keep the replaced file,the new file has no free page
+        this->databases.erase( job.save_id );
+        this->written_archives.erase( job.save_id );
+        //log of the replaced file must not be applied to the new one
+        std::remove( ( archive_path + std::string( "-wal" ) ).c_str() );
+        std::remove( ( archive_path + std::string( "-shm" ) ).c_str() );
+        //atomic on POSIX,the slot hold either the old or the new archive
+        if ( std::rename( temp_path.c_str() , archive_path.c_str() ) != 0 )
+        {
+            throw std::runtime_error( std::string( "rename:" ) + temp_path + std::string( " to " ) + archive_path + std::string( " failure" ) );
+        }
+    }
+
+    TowerDelta SaveService::diff_snapshot( const SaveJob& job )
+    {
+        //new game of another gamemap
+        if ( this->floor_deltas_hash != job.baseline_hash )
+        {
+            this->floor_deltas.clear();
+            this->floor_deltas_hash = job.baseline_hash;
+        }
+        TowerDelta delta;
+        for ( auto& [ floor_id , floor ] : job.tower )
+        {
+            //floor missing in baseline is not representable
+            auto base_iter = job.baseline.find( floor_id );
+            if ( base_iter == job.baseline.end() || base_iter->second->generation == floor->generation )
+            {
+                this->floor_deltas.erase( floor_id );
+                continue;
+            }
+            //generation start from 1,new entry always diff
+            auto& [ generation , floor_delta ] = this->floor_deltas[ floor_id ];
+            if ( generation != floor->generation )
+            {
+                generation = floor->generation;
+                floor_delta.clear();
+                diff_floor( floor_id , *( base_iter->second ) , *floor , floor_delta );
+            }
+            //map order,delta stay sorted by ( floor_id , index )
+            delta.insert( delta.end() , floor_delta.begin() , floor_delta.end() );
+        }
+        for ( auto iter = this->floor_deltas.begin() ; iter != this->floor_deltas.end() ; )
+        {
+            if ( job.tower.find( iter->first ) == job.tower.end() )
+                iter = this->floor_deltas.erase( iter );
+            else
+                iter++;
+        }
+        return delta;
+    }
+
+    SaveIndex& SaveService::get_index( void )
+    {
+        if ( !this->index )
+        {
+            this->index = std::make_unique<SaveIndex>( ResourcesManager::get_save_path() + std::string( "index.db" ) );
+        }
+        return *( this->index );
+    }
+
+    void SaveService::read_index( void )
+    {
+        std::map<std::size_t,SaveSlotInfo> stored;
+        std::string error_message;
+        try
+        {
+            std::lock_guard<std::mutex> lock( this->database_mutex );
+            stored = this->get_index().get_slots();
+        }
+        catch ( const std::runtime_error& e )
+        {
+            //no save directory yet or broken index,the menu show what this session saved
+            error_message = e.what();
+        }
+        {
+            std::lock_guard<std::mutex> lock( this->job_mutex );
+            this->stored_slots = std::move( stored );
+            this->index_error = std::move( error_message );
+        }
+        this->dispatcher.emit();
+    }
+
+    void SaveService::worker_loop( void )
+    {
+        this->read_index();
+        while ( true )
+        {
+            SaveJob job;
+            {
+                std::unique_lock<std::mutex> lock( this->job_mutex );
+                this->job_condition.wait( lock , [ this ](){ return this->stop || !this->jobs.empty(); } );
+                //pending saves are finished before exit
+                if ( this->jobs.empty() )
+                    break;
+                job = std::move( this->jobs.front() );
+                this->jobs.pop_front();
+                this->busy = true;
+            }
+
+            //no g_log here,the message is logged on main thread
+            SaveResult result = { true , {} , std::move( job.slot_info ) , std::move( job.done ) };
+            bool saved = false;
+            try
+            {
+                TowerDelta delta = this->diff_snapshot( job );
+                if ( job.replace )
+                {
+                    this->replace_archive( job , delta );
+                }
+                std::lock_guard<std::mutex> lock( this->database_mutex );
+                if ( !job.replace )
+                {
+                    this->get_database( job.save_id ).save_snapshot( delta , job.baseline_hash , get_generations( job.tower ) ,
+                        job.hero , job.flags , job.inventories );
+                    this->written_archives.insert( job.save_id );
+                }
+                saved = true;
+                //after the archive committed,a row never describe an unsaved archive
+                this->get_index().set_slot( result.slot_info );
+            }
+            catch ( const std::runtime_error& e )
+            {
+                result.success = saved;
+                result.error_message = e.what();
+            }
+            //the floor copies are released here,not on main thread
+            job.tower.clear();
+            job.baseline.clear();
+
+            {
+                std::lock_guard<std::mutex> lock( this->job_mutex );
+                this->results.push_back( std::move( result ) );
+                this->busy = false;
+            }
+            this->idle_condition.notify_all();
+            this->dispatcher.emit();
+        }
+
+        //on quit,shrink the archives written this session
+        std::lock_guard<std::mutex> lock( this->database_mutex );
+        for ( std::size_t save_id : this->written_archives )
+        {
+            auto database_iter = this->databases.find( save_id );
+            if ( database_iter == this->databases.end() )
+                continue;
+            try
+            {
+                database_iter->second->maintenance();
+            }
+            catch ( const std::runtime_error& )
+            {
+                //an archive opened by another process stay as it is
+            }
+        }
+    }
+
+    void SaveService::upload_results( void )
+    {
+        std::vector<SaveResult> finished;
+        std::optional<std::map<std::size_t,SaveSlotInfo>> stored;
+        std::string error_message;
+        {
+            std::lock_guard<std::mutex> lock( this->job_mutex );
+            finished.swap( this->results );
+            stored.swap( this->stored_slots );
+            error_message.swap( this->index_error );
+        }
+        //read before any save,the saves finished later overwrite the rows
+        if ( stored.has_value() )
+        {
+            this->slot_infos.swap( stored.value() );
+            if ( !error_message.empty() )
+                g_log( __func__ , G_LOG_LEVEL_MESSAGE , "%s" , error_message.c_str() );
+        }
+        for ( auto& result : finished )
+        {
+            if ( result.success )
+                this->slot_infos[ result.slot_info.slot_id ] = result.slot_info;
+            if ( result.done )
+                result.done( result.success , result.error_message );
+        }
+    }
+}
@@ -0,0 +1,153 @@
+#pragma once
+#ifndef SAVE_SERVICE_H
+#define SAVE_SERVICE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <glibmm.h>
+
+#include "database.h"
+#include "hero.h"
+#include "save_index.h"
+#include "tower.h"
+
+namespace MagicTower
+{
+    //save archive on a dedicated I/O thread.
+    //the main thread take a snapshot:floors are shared immutable copies,only the floors changed since the last
+    //snapshot are copied again.saves run one by one in submit order,so saves of same slot never overlap.
+    //the archive connections are owned by the service,load use them on main thread after pending saves finished.
+    //archive store the grids differ from the baseline tower,diff on I/O thread.
+    //the diff of a floor is kept until the floor changed,a save rescan only the floors changed since the last save.
+    //slot metadata is written to the save index after the archive committed,the main thread keep a copy for menu.
+    //the index is read on I/O thread at start,before any save
+    class SaveService
+    {
+    public:
+        //success,error message
+        typedef std::function<void( bool , const std::string& )> SaveCallback;
+
+        SaveService();
+        //finish the pending saves and maintain the archives updated this session before return
+        ~SaveService();
+
+        //main thread only,done is called on main thread after the save finished.
+        //error message of the save index is passed with success true,the archive is saved
+        void save( std::size_t save_id , const TowerMap& tower , const Hero& hero ,
+            const std::map<std::string , std::uint32_t>& flags , const std::map<std::uint32_t , std::uint32_t>& inventories ,
+            std::int64_t play_time , SaveCallback done );
+        //write a new archive to a temp file,then rename it over the slot archive.
+        //a crash during the save leave the old archive intact,cost a full write,used by autosave
+        void save_replace( std::size_t save_id , const TowerMap& tower , const Hero& hero ,
+            const std::map<std::string , std::uint32_t>& flags , const std::map<std::uint32_t , std::uint32_t>& inventories ,
+            std::int64_t play_time , SaveCallback done );
+        //pristine tower loaded from gamemap,main thread only
+        void set_baseline( const TowerMap& tower );
+        //copy of baseline,the floors keep the baseline generation
+        TowerMap get_baseline( void ) const;
+        std::uint64_t get_baseline_hash( void ) const;
+        //main thread only,wait for pending saves,then call reader with the connection of slot.
+        //std::runtime_error of open or reader is passed to caller
+        void read( std::size_t save_id , const std::function<void( DataBase& )>& reader );
+        bool has_pending( void );
+        //main thread only,copy of the save index updated by finished saves,never block.
+        //empty until the index read at start uploaded
+        const std::map<std::size_t,SaveSlotInfo>& get_slots( void );
+        //main thread only,floors unchanged since the last snapshot share the same copy
+        TowerSnapshot snapshot_tower( const TowerMap& tower );
+
+        SaveService( const SaveService& rhs )=delete;
+        SaveService( SaveService&& rhs )=delete;
+        SaveService& operator=( const SaveService& rhs )=delete;
+        SaveService& operator=( SaveService&& rhs )=delete;
+    private:
+        struct SaveJob
+        {
+            std::size_t save_id;
+            TowerSnapshot baseline;
+            std::uint64_t baseline_hash;
+            TowerSnapshot tower;
+            Hero hero;
+            std::map<std::string , std::uint32_t> flags;
+            std::map<std::uint32_t , std::uint32_t> inventories;
+            SaveSlotInfo slot_info;
+            //save_replace
+            bool replace;
+            SaveCallback done;
+        };
+
+        struct SaveResult
+        {
+            bool success;
+            std::string error_message;
+            SaveSlotInfo slot_info;
+            SaveCallback done;
+        };
+
+        void submit( std::size_t save_id , const TowerMap& tower , const Hero& hero ,
+            const std::map<std::string , std::uint32_t>& flags , const std::map<std::uint32_t , std::uint32_t>& inventories ,
+            std::int64_t play_time , bool replace , SaveCallback done );
+        //I/O thread,temp file and rename
+        void replace_archive( const SaveJob& job , const TowerDelta& delta );
+        //I/O thread,the tower of job as delta,from floor_deltas if the floor not changed
+        TowerDelta diff_snapshot( const SaveJob& job );
+        //guard by database_mutex
+        DataBase& get_database( std::size_t save_id );
+        //guard by database_mutex
+        SaveIndex& get_index( void );
+        //I/O thread,before the first job
+        void read_index( void );
+        void worker_loop( void );
+        void upload_results( void );
+
+        //main thread only,last shared copy of every floor
+        TowerSnapshot floor_cache;
+        TowerSnapshot baseline;
+        std::uint64_t baseline_hash;
+        //main thread only,copy of the save index
+        std::map<std::size_t,SaveSlotInfo> slot_infos;
+
+        //I/O thread only,floor id -> ( generation , grids differ from baseline ) of the last diff
+        std::map<std::uint32_t , std::pair<std::uint64_t , TowerDelta>> floor_deltas;
+        //baseline of floor_deltas
+        std::uint64_t floor_deltas_hash;
+
+        //save_id -> connection,guard by database_mutex
+        std::mutex database_mutex;
+        std::map<std::size_t , std::unique_ptr<DataBase>> databases;
+        //updated in place this session,maintained on quit.load only connection is not
+        std::set<std::size_t> written_archives;
+        std::unique_ptr<SaveIndex> index;
+
+        //shared with worker,guard by job_mutex
+        std::mutex job_mutex;
+        std::condition_variable job_condition;
+        std::condition_variable idle_condition;
+        std::deque<SaveJob> jobs;
+        std::vector<SaveResult> results;
+        //rows read by read_index,error message if failure
+        std::optional<std::map<std::size_t,SaveSlotInfo>> stored_slots;
+        std::string index_error;
+        bool busy;
+        bool stop;
+
+        Glib::Dispatcher dispatcher;
+        std::thread worker;
+    };
+}
+
+#endif
@@ -0,0 +1,643 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cairomm/cairomm.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <glibmm.h>
+#include <glib/gstdio.h>
+
+#include "resources.h"
+#include "sprite_cache.h"
+
+namespace MagicTower
+{
+    static const char atlas_magic[8] = { 'M' , 'T' , 'S' , 'P' , 'R' , 'I' , 'T' , 'E' };
+    static const std::uint32_t atlas_version = 2;
+    //longer strip is truncated
+    static const std::uint32_t max_animation_frames = 16;
+
+    /*  atlas file layout(native byte order):
+        AtlasHeader
+        count*( std::uint32_t name length , name )
+        pixel data at data_offset:count*pixel_size*pixel_size premultiplied ARGB32,same order as name
+        animation frame n( n >= 1 ) is named by frame_key
+    */
+    struct AtlasHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t pixel_size;
+        std::uint32_t count;
+        std::uint32_t data_offset;
+        std::uint8_t source_hash[32];
+    };
+
+    static const cairo_user_data_key_t atlas_mapping_key = {};
+
+    //surface pixel = logical pixel*scale
+    static void set_device_scale( const Cairo::RefPtr<Cairo::ImageSurface>& surface , std::uint32_t scale )
+    {
+        cairo_surface_set_device_scale( surface->cobj() , scale , scale );
+    }
+
+    static std::string frame_key( const std::string& image_path , std::uint32_t frame )
+    {
+        return image_path + "#" + std::to_string( frame );
+    }
+
+    //path,size and modify time of every image,only stat the files:reading all image content block the startup
+    static std::string compute_source_hash( const std::set<std::string>& image_paths )
+    {
+        GChecksum * checksum = g_checksum_new( G_CHECKSUM_SHA256 );
+        for ( auto& image_path : image_paths )
+        {
+            g_checksum_update( checksum , reinterpret_cast<const guchar *>( image_path.c_str() ) , image_path.size() + 1 );
+            GStatBuf stat_buf;
+            //missing file hash as size -1
+            std::int64_t stamp[2] = { -1 , 0 };
+            if ( g_stat( image_path.c_str() , &stat_buf ) == 0 )
+            {
+                stamp[0] = static_cast<std::int64_t>( stat_buf.st_size );
+                stamp[1] = static_cast<std::int64_t>( stat_buf.st_mtime );
+            }
+            g_checksum_update( checksum , reinterpret_cast<const guchar *>( stamp ) , sizeof( stamp ) );
+        }
+        std::string digest( 32 , '\0' );
+        gsize digest_length = digest.size();
+        g_checksum_get_digest( checksum , reinterpret_cast<guint8 *>( &digest[0] ) , &digest_length );
+        g_checksum_free( checksum );
+        return digest;
+    }
+
+    //run on worker thread:no GTK,no g_log(log writer is not thread safe)
+    static std::string decode_image( const std::string& image_path , std::uint32_t pixel_size ,
+        std::vector<std::uint32_t>& pixels , std::uint32_t& frame_count )
+    {
+        //horizontal strip:every frame is a square
+        int file_width = 0;
+        int file_height = 0;
+        std::uint32_t strip_frames = 1;
+        if ( ( gdk_pixbuf_get_file_info( image_path.c_str() , &file_width , &file_height ) != nullptr ) &&
+            ( file_height > 0 ) && ( file_width >= 2*file_height ) && ( file_width%file_height == 0 ) )
+            strip_frames = file_width/file_height;
+        frame_count = std::min( strip_frames , max_animation_frames );
+
+        GError * error = nullptr;
+        //same as Gdk::Pixbuf::create_from_file( path , width , height ):keep aspect ratio
+        GdkPixbuf * pixbuf = gdk_pixbuf_new_from_file_at_size( image_path.c_str() , pixel_size*strip_frames , pixel_size , &error );
+        if ( pixbuf == nullptr )
+        {
+            std::string error_message = ( error != nullptr ) ? error->message : "unknown error";
+            if ( error != nullptr )
+                g_error_free( error );
+            return error_message;
+        }
+
+        int width = std::min<int>( gdk_pixbuf_get_width( pixbuf ) , pixel_size*frame_count );
+        int height = std::min<int>( gdk_pixbuf_get_height( pixbuf ) , pixel_size );
+        int channels = gdk_pixbuf_get_n_channels( pixbuf );
+        int rowstride = gdk_pixbuf_get_rowstride( pixbuf );
+        bool has_alpha = gdk_pixbuf_get_has_alpha( pixbuf );
+        const guchar * data = gdk_pixbuf_read_pixels( pixbuf );
+
+        //convert RGB(A) to cairo premultiplied ARGB32,as gdk_cairo_set_source_pixbuf
+        auto multiply = []( std::uint32_t color , std::uint32_t alpha ) -> std::uint32_t
+        {
+            std::uint32_t temp = color*alpha + 0x80;
+            return ( ( temp >> 8 ) + temp ) >> 8;
+        };
+        pixels.assign( static_cast<std::size_t>( frame_count )*pixel_size*pixel_size , 0 );
+        for ( int y = 0 ; y < height ; y++ )
+        {
+            const guchar * row = data + y*rowstride;
+            for ( int x = 0 ; x < width ; x++ )
+            {
+                const guchar * pixel = row + x*channels;
+                std::uint32_t alpha = has_alpha ? pixel[3] : 0xFF;
+                std::uint32_t red = multiply( pixel[0] , alpha );
+                std::uint32_t green = multiply( pixel[1] , alpha );
+                std::uint32_t blue = multiply( pixel[2] , alpha );
+                //frame by frame,each frame pixel_size*pixel_size
+                std::size_t frame = x/pixel_size;
+                std::size_t index = ( frame*pixel_size + y )*pixel_size + x%pixel_size;
+                pixels[index] = ( alpha << 24 ) | ( red << 16 ) | ( green << 8 ) | blue;
+            }
+        }
+        g_object_unref( pixbuf );
+
+        return {};
+    }
+
+    SpriteCache::SpriteCache():
+        pixel_size( 32 ),
+        scale( 1 ),
+        target_pixel_size( 0 ),
+        target_scale( 0 ),
+        rescaling( false ),
+        generation( 0 ),
+        epoch( 0 ),
+        placeholder(),
+        image_paths(),
+        sprites(),
+        frame_counts(),
+        pending_placeholder(),
+        pending_sprites(),
+        pending_frame_counts(),
+        pending_needed(),
+        queued(),
+        sprites_ready(),
+        source_hash(),
+        atlas_ready( false ),
+        job_mutex(),
+        job_condition(),
+        jobs(),
+        results(),
+        in_flight( 0 ),
+        stop( false ),
+        dispatcher(),
+        workers()
+    {
+        //only list the directory,image decode is deferred to first use
+        std::vector<std::string> paths = ResourcesManager::get_images();
+        this->image_paths.insert( paths.begin() , paths.end() );
+        this->source_hash = compute_source_hash( this->image_paths );
+        this->set_pixel_size( this->pixel_size );
+
+        this->dispatcher.connect( sigc::mem_fun( *this , &SpriteCache::upload_results ) );
+        unsigned int worker_count = std::clamp( std::thread::hardware_concurrency() , 1u , 4u );
+        for ( unsigned int i = 0 ; i < worker_count ; i++ )
+        {
+            this->workers.emplace_back( &SpriteCache::worker_loop , this );
+        }
+    }
+
+    SpriteCache::~SpriteCache()
+    {
+        {
+            std::lock_guard<std::mutex> lock( this->job_mutex );
+            this->stop = true;
+            this->jobs.clear();
+        }
+        this->job_condition.notify_all();
+        for ( auto& worker : this->workers )
+        {
+            worker.join();
+        }
+    }
+
+    void SpriteCache::set_pixel_size( std::uint32_t _pixel_size , std::uint32_t _scale )
+    {
+        _scale = std::max<std::uint32_t>( _scale , 1 );
+        if ( ( this->target_pixel_size == _pixel_size ) && ( this->target_scale == _scale ) )
+            return ;
+        this->target_pixel_size = _pixel_size;
+        this->target_scale = _scale;
+        this->epoch++;
+        this->queued.clear();
+        {
+            std::lock_guard<std::mutex> lock( this->job_mutex );
+            this->jobs.clear();
+        }
+        this->pending_sprites.clear();
+        this->pending_frame_counts.clear();
+        this->pending_needed.clear();
+
+        //back to the displayed size before rescale finished,the displayed sprites are still complete
+        if ( this->placeholder && ( this->pixel_size == _pixel_size ) && ( this->scale == _scale ) )
+        {
+            this->rescaling = false;
+            return ;
+        }
+
+        std::uint32_t device_size = this->target_pixel_size*this->target_scale;
+        this->pending_placeholder = Cairo::ImageSurface::create( Cairo::Format::FORMAT_ARGB32 , device_size , device_size );
+        auto cairo_context = Cairo::Context::create( this->pending_placeholder );
+        cairo_context->set_source_rgb( 0 , 0 , 0 );
+        cairo_context->paint();
+        set_device_scale( this->pending_placeholder , this->target_scale );
+        this->pending_sprites[ResourcesManager::get_image( "backup" , 1 )] = this->pending_placeholder;
+        this->rescaling = true;
+        this->atlas_ready = this->load_atlas();
+
+        //every displayed image is needed before swap,so the frame never fall back to placeholder
+        for ( auto& sprite : this->sprites )
+        {
+            if ( this->image_paths.find( sprite.first ) != this->image_paths.end() &&
+                this->pending_sprites.find( sprite.first ) == this->pending_sprites.end() )
+                this->pending_needed.insert( sprite.first );
+        }
+        if ( this->pending_needed.empty() )
+        {
+            this->swap_pending();
+            return ;
+        }
+        for ( auto& image_path : this->pending_needed )
+        {
+            this->enqueue( image_path , false );
+        }
+    }
+
+    void SpriteCache::swap_pending( void )
+    {
+        this->pixel_size = this->target_pixel_size;
+        this->scale = this->target_scale;
+        this->sprites.swap( this->pending_sprites );
+        this->frame_counts.swap( this->pending_frame_counts );
+        this->placeholder = this->pending_placeholder;
+        this->pending_placeholder.clear();
+        this->pending_sprites.clear();
+        this->pending_frame_counts.clear();
+        this->pending_needed.clear();
+        this->rescaling = false;
+        this->generation++;
+    }
+
+    std::uint32_t SpriteCache::get_pixel_size( void ) const
+    {
+        return this->pixel_size;
+    }
+
+    std::uint32_t SpriteCache::get_scale( void ) const
+    {
+        return this->scale;
+    }
+
+    Cairo::RefPtr<Cairo::ImageSurface> SpriteCache::get_sprite( const std::string& image_path , std::uint64_t frame )
+    {
+        auto count_iter = this->frame_counts.find( image_path );
+        if ( count_iter != this->frame_counts.end() && frame%count_iter->second != 0 )
+        {
+            auto frame_iter = this->sprites.find( frame_key( image_path , frame%count_iter->second ) );
+            if ( frame_iter != this->sprites.end() )
+                return frame_iter->second;
+        }
+        auto iter = this->sprites.find( image_path );
+        if ( iter != this->sprites.end() )
+        {
+            return iter->second;
+        }
+        if ( this->image_paths.find( image_path ) == this->image_paths.end() )
+        {
+            g_log( __func__ , G_LOG_LEVEL_WARNING , "image resource \'%s\' not found,fallback to backup image." , image_path.c_str() );
+            this->sprites[image_path] = this->placeholder;
+            return this->placeholder;
+        }
+        //already rescaled,wait for swap
+        if ( this->rescaling && this->pending_sprites.find( image_path ) != this->pending_sprites.end() )
+            return this->placeholder;
+        this->enqueue( image_path , true );
+        return this->placeholder;
+    }
+
+    std::uint32_t SpriteCache::get_frame_count( const std::string& image_path ) const
+    {
+        auto iter = this->frame_counts.find( image_path );
+        if ( iter == this->frame_counts.end() )
+            return 1;
+        return iter->second;
+    }
+
+    bool SpriteCache::is_decoded( const std::string& image_path ) const
+    {
+        auto iter = this->sprites.find( image_path );
+        return iter != this->sprites.end() && iter->second != this->placeholder;
+    }
+
+    void SpriteCache::prefetch( const std::string& image_path )
+    {
+        if ( this->sprites.find( image_path ) != this->sprites.end() )
+            return ;
+        if ( this->image_paths.find( image_path ) == this->image_paths.end() )
+            return ;
+        if ( this->rescaling && this->pending_sprites.find( image_path ) != this->pending_sprites.end() )
+            return ;
+        this->enqueue( image_path , false );
+    }
+
+    void SpriteCache::prefetch_all( void )
+    {
+        for ( auto& image_path : this->image_paths )
+        {
+            this->prefetch( image_path );
+        }
+    }
+
+    bool SpriteCache::has_pending( void )
+    {
+        std::lock_guard<std::mutex> lock( this->job_mutex );
+        return ( !this->jobs.empty() ) || ( this->in_flight > 0 ) || ( !this->results.empty() );
+    }
+
+    const std::set<std::string>& SpriteCache::get_image_paths( void ) const
+    {
+        return this->image_paths;
+    }
+
+    std::uint64_t SpriteCache::get_generation( void ) const
+    {
+        return this->generation;
+    }
+
+    std::size_t SpriteCache::get_decoded_count( void ) const
+    {
+        return this->sprites.size();
+    }
+
+    sigc::signal<void> SpriteCache::signal_sprites_ready( void )
+    {
+        return this->sprites_ready;
+    }
+
+    void SpriteCache::enqueue( const std::string& image_path , bool urgent )
+    {
+        bool submitted = ( this->queued.find( image_path ) != this->queued.end() );
+        if ( submitted && !urgent )
+            return ;
+        this->queued.insert( image_path );
+
+        {
+            std::lock_guard<std::mutex> lock( this->job_mutex );
+            if ( submitted )
+            {
+                //prefetched image is used now,move to front.if not found,worker already take it
+                auto iter = std::find_if( this->jobs.begin() , this->jobs.end() ,
+                    [ &image_path ]( const DecodeJob& job ){ return job.image_path == image_path; } );
+                if ( iter == this->jobs.end() )
+                    return ;
+                this->jobs.erase( iter );
+            }
+            std::uint32_t device_size = this->target_pixel_size*this->target_scale;
+            if ( urgent )
+                this->jobs.push_front( { image_path , device_size , this->epoch } );
+            else
+                this->jobs.push_back( { image_path , device_size , this->epoch } );
+        }
+        this->job_condition.notify_one();
+    }
+
+    void SpriteCache::worker_loop( void )
+    {
+        while ( true )
+        {
+            DecodeJob job;
+            {
+                std::unique_lock<std::mutex> lock( this->job_mutex );
+                this->job_condition.wait( lock , [ this ](){ return this->stop || !this->jobs.empty(); } );
+                if ( this->stop )
+                    return ;
+                job = this->jobs.front();
+                this->jobs.pop_front();
+                this->in_flight++;
+            }
+
+            DecodeResult result = { job.image_path , job.epoch , {} , 1 , {} };
+            result.error_message = decode_image( job.image_path , job.pixel_size , result.pixels , result.frame_count );
+
+            {
+                std::lock_guard<std::mutex> lock( this->job_mutex );
+                this->in_flight--;
+                this->results.push_back( std::move( result ) );
+            }
+            this->dispatcher.emit();
+        }
+    }
+
+    void SpriteCache::upload_results( void )
+    {
+        std::vector<DecodeResult> decoded;
+        {
+            std::lock_guard<std::mutex> lock( this->job_mutex );
+            decoded.swap( this->results );
+        }
+
+        bool uploaded = false;
+        //decode always target size,collect aside while rescaling
+        auto& target_sprites = this->rescaling ? this->pending_sprites : this->sprites;
+        auto& target_frame_counts = this->rescaling ? this->pending_frame_counts : this->frame_counts;
+        auto& target_placeholder = this->rescaling ? this->pending_placeholder : this->placeholder;
+        std::uint32_t device_size = this->target_pixel_size*this->target_scale;
+        for ( auto& result : decoded )
+        {
+            //pixel size changed after submit
+            if ( result.epoch != this->epoch )
+                continue;
+            this->queued.erase( result.image_path );
+            this->pending_needed.erase( result.image_path );
+            if ( !result.error_message.empty() )
+            {
+                g_log( __func__ , G_LOG_LEVEL_WARNING , "decode \'%s\' failure,error message:%s,fallback to backup image." ,
+                    result.image_path.c_str() , result.error_message.c_str() );
+                target_sprites[result.image_path] = target_placeholder;
+                continue;
+            }
+
+            std::size_t frame_pixels = static_cast<std::size_t>( device_size )*device_size;
+            for ( std::uint32_t frame = 0 ; frame < result.frame_count ; frame++ )
+            {
+                auto surface = Cairo::ImageSurface::create( Cairo::Format::FORMAT_ARGB32 , device_size , device_size );
+                surface->flush();
+                unsigned char * data = surface->get_data();
+                int stride = surface->get_stride();
+                for ( std::uint32_t y = 0 ; y < device_size ; y++ )
+                {
+                    std::memcpy( data + y*stride , result.pixels.data() + frame*frame_pixels + y*device_size ,
+                        device_size*sizeof( std::uint32_t ) );
+                }
+                surface->mark_dirty();
+                set_device_scale( surface , this->target_scale );
+                target_sprites[ frame == 0 ? result.image_path : frame_key( result.image_path , frame ) ] = surface;
+            }
+            if ( result.frame_count > 1 )
+                target_frame_counts[result.image_path] = result.frame_count;
+            if ( !this->rescaling )
+                uploaded = true;
+        }
+        if ( this->rescaling && this->pending_needed.empty() )
+        {
+            this->swap_pending();
+            uploaded = true;
+        }
+
+        if ( uploaded )
+        {
+            this->generation++;
+            this->sprites_ready.emit();
+        }
+
+        //all image of this pixel size decoded,write atlas for next launch
+        if ( !this->atlas_ready && !this->rescaling && !this->has_pending() )
+        {
+            bool complete = std::all_of( this->image_paths.begin() , this->image_paths.end() ,
+                [ this ]( const std::string& image_path ){ return this->sprites.find( image_path ) != this->sprites.end(); } );
+            if ( complete )
+            {
+                this->atlas_ready = true;
+                this->save_atlas();
+            }
+        }
+    }
+
+    std::string SpriteCache::get_atlas_path( std::uint32_t device_size ) const
+    {
+        return ResourcesManager::get_save_path() + std::string( "sprites_" ) + std::to_string( device_size ) + std::string( ".atlas" );
+    }
+
+    bool SpriteCache::load_atlas( void )
+    {
+        std::uint32_t device_size = this->target_pixel_size*this->target_scale;
+        std::string atlas_path = this->get_atlas_path( device_size );
+        if ( !Glib::file_test( atlas_path , Glib::FileTest::FILE_TEST_IS_REGULAR ) )
+            return false;
+
+        GError * error = nullptr;
+        //writable is private copy-on-write mapping,cairo surface need non-const data
+        GMappedFile * mapped_file = g_mapped_file_new( atlas_path.c_str() , TRUE , &error );
+        if ( mapped_file == nullptr )
+        {
+            g_log( __func__ , G_LOG_LEVEL_WARNING , "map '%s' failure,error message:%s" , atlas_path.c_str() , error->message );
+            g_error_free( error );
+            return false;
+        }
+
+        char * contents = g_mapped_file_get_contents( mapped_file );
+        std::size_t length = g_mapped_file_get_length( mapped_file );
+        std::size_t sprite_bytes = static_cast<std::size_t>( device_size )*device_size*sizeof( std::uint32_t );
+        AtlasHeader header;
+        bool valid = ( length >= sizeof( AtlasHeader ) );
+        if ( valid )
+        {
+            std::memcpy( &header , contents , sizeof( AtlasHeader ) );
+            valid = ( std::memcmp( header.magic , atlas_magic , sizeof( atlas_magic ) ) == 0 ) &&
+                ( header.version == atlas_version ) && ( header.pixel_size == device_size ) &&
+                ( std::memcmp( header.source_hash , this->source_hash.data() , sizeof( header.source_hash ) ) == 0 ) &&
+                ( header.data_offset >= sizeof( AtlasHeader ) ) && ( header.data_offset <= length ) &&
+                ( header.count <= ( length - header.data_offset )/sprite_bytes );
+        }
+
+        std::vector<std::string> names;
+        std::size_t offset = sizeof( AtlasHeader );
+        for ( std::uint32_t i = 0 ; valid && i < header.count ; i++ )
+        {
+            std::uint32_t name_length = 0;
+            if ( offset + sizeof( name_length ) > header.data_offset )
+            {
+                valid = false;
+                break;
+            }
+            std::memcpy( &name_length , contents + offset , sizeof( name_length ) );
+            offset += sizeof( name_length );
+            if ( name_length > header.data_offset - offset )
+            {
+                valid = false;
+                break;
+            }
+            names.emplace_back( contents + offset , name_length );
+            offset += name_length;
+        }
+        if ( !valid )
+        {
+            g_log( __func__ , G_LOG_LEVEL_MESSAGE , "sprite atlas '%s' outdated or broken,decode from image file" , atlas_path.c_str() );
+            g_mapped_file_unref( mapped_file );
+            return false;
+        }
+
+        for ( std::uint32_t i = 0 ; i < header.count ; i++ )
+        {
+            unsigned char * data = reinterpret_cast<unsigned char *>( contents + header.data_offset + i*sprite_bytes );
+            auto surface = Cairo::ImageSurface::create( data , Cairo::Format::FORMAT_ARGB32 ,
+                device_size , device_size , device_size*sizeof( std::uint32_t ) );
+            set_device_scale( surface , this->target_scale );
+            //every surface hold a reference,unmap after the last sprite released
+            cairo_surface_set_user_data( surface->cobj() , &atlas_mapping_key , g_mapped_file_ref( mapped_file ) ,
+                reinterpret_cast<cairo_destroy_func_t>( g_mapped_file_unref ) );
+            this->pending_sprites[names[i]] = surface;
+
+            //frame n of animated image
+            std::size_t separator = names[i].rfind( '#' );
+            if ( separator != std::string::npos && this->image_paths.find( names[i].substr( 0 , separator ) ) != this->image_paths.end() )
+            {
+                std::uint32_t frame = std::strtoul( names[i].c_str() + separator + 1 , nullptr , 10 );
+                std::uint32_t& frame_count = this->pending_frame_counts[ names[i].substr( 0 , separator ) ];
+                frame_count = std::max( frame_count , frame + 1 );
+            }
+        }
+        g_mapped_file_unref( mapped_file );
+
+        return true;
+    }
+
+    void SpriteCache::save_atlas( void )
+    {
+        std::vector<std::pair<std::string,Cairo::RefPtr<Cairo::ImageSurface>>> entries;
+        for ( auto& image_path : this->image_paths )
+        {
+            auto iter = this->sprites.find( image_path );
+            //decode failure use placeholder,try again next launch
+            if ( iter == this->sprites.end() || iter->second == this->placeholder )
+                continue;
+            entries.push_back( { image_path , iter->second } );
+            for ( std::uint32_t frame = 1 ; frame < this->get_frame_count( image_path ) ; frame++ )
+            {
+                auto frame_iter = this->sprites.find( frame_key( image_path , frame ) );
+                if ( frame_iter != this->sprites.end() )
+                    entries.push_back( { frame_iter->first , frame_iter->second } );
+            }
+        }
+
+        std::uint32_t device_size = this->pixel_size*this->scale;
+        std::size_t sprite_bytes = static_cast<std::size_t>( device_size )*device_size*sizeof( std::uint32_t );
+        std::size_t index_bytes = 0;
+        for ( auto& entry : entries )
+        {
+            index_bytes += sizeof( std::uint32_t ) + entry.first.size();
+        }
+        //pixel data aligned to 64 byte
+        std::size_t data_offset = ( sizeof( AtlasHeader ) + index_bytes + 63 )/64*64;
+
+        std::string contents( data_offset + entries.size()*sprite_bytes , '\0' );
+        AtlasHeader header;
+        std::memcpy( header.magic , atlas_magic , sizeof( atlas_magic ) );
+        header.version = atlas_version;
+        header.pixel_size = device_size;
+        header.count = entries.size();
+        header.data_offset = data_offset;
+        std::memcpy( header.source_hash , this->source_hash.data() , sizeof( header.source_hash ) );
+        std::memcpy( &contents[0] , &header , sizeof( AtlasHeader ) );
+
+        std::size_t offset = sizeof( AtlasHeader );
+        for ( std::size_t i = 0 ; i < entries.size() ; i++ )
+        {
+            std::uint32_t name_length = entries[i].first.size();
+            std::memcpy( &contents[offset] , &name_length , sizeof( name_length ) );
+            offset += sizeof( name_length );
+            std::memcpy( &contents[offset] , entries[i].first.data() , name_length );
+            offset += name_length;
+
+            auto& surface = entries[i].second;
+            surface->flush();
+            const unsigned char * data = surface->get_data();
+            int stride = surface->get_stride();
+            char * destination = &contents[data_offset + i*sprite_bytes];
+            for ( std::uint32_t y = 0 ; y < device_size ; y++ )
+            {
+                std::memcpy( destination + y*device_size*sizeof( std::uint32_t ) , data + y*stride , device_size*sizeof( std::uint32_t ) );
+            }
+        }
+
+        g_mkdir_with_parents( ResourcesManager::get_save_path().c_str() , 0755 );
+        std::string atlas_path = this->get_atlas_path( device_size );
+        GError * error = nullptr;
+        //write temp file then rename,never leave half written atlas
+        if ( !g_file_set_contents( atlas_path.c_str() , contents.data() , contents.size() , &error ) )
+        {
+            g_log( __func__ , G_LOG_LEVEL_WARNING , "write '%s' failure,error message:%s" , atlas_path.c_str() , error->message );
+            g_error_free( error );
+        }
+    }
+}
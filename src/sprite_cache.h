@@ -0,0 +1,143 @@
+#pragma once
+#ifndef SPRITE_CACHE_H
+#define SPRITE_CACHE_H
+
+#include <cstdint>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cairomm/cairomm.h>
+#include <glibmm.h>
+#include <sigc++/sigc++.h>
+
+namespace MagicTower
+{
+    //image file -> pixel_size*pixel_size surface,decode on first use.
+    //decode and scale run on worker threads into CPU buffer,surface upload run on main thread.
+    //all scaled sprites of one pixel size are written to an atlas file under save path,
+    //next launch map it directly if the source images not changed.
+    //image whose width is n( >= 2 ) times its height is a horizontal strip of n animation frames.
+    //size change is asynchronous:sprites of new size are collected aside and swapped in at once,
+    //the old sprites stay in use until then
+    class SpriteCache
+    {
+    public:
+        SpriteCache();
+        ~SpriteCache();
+
+        //pixel_size:logical grid size,scale:widget scale factor,surface has pixel_size*scale pixels and device scale.
+        //rescale the displayed sprites in background,the in-flight decode of old request will be discarded
+        void set_pixel_size( std::uint32_t pixel_size , std::uint32_t scale = 1 );
+        //size of the displayed sprites
+        std::uint32_t get_pixel_size( void ) const;
+        std::uint32_t get_scale( void ) const;
+
+        //if not decoded,queue the decode and return placeholder(backup image).
+        //frame:animation frame,wrap around the frame count
+        Cairo::RefPtr<Cairo::ImageSurface> get_sprite( const std::string& image_path , std::uint64_t frame = 0 );
+        //1 if not animated or not decoded yet
+        std::uint32_t get_frame_count( const std::string& image_path ) const;
+        //true if get_sprite return the decoded image,not placeholder
+        bool is_decoded( const std::string& image_path ) const;
+        //queue the decode after all get_sprite request
+        void prefetch( const std::string& image_path );
+        //queue all image file
+        void prefetch_all( void );
+
+        bool has_pending( void );
+        //all image file in resources directory
+        const std::set<std::string>& get_image_paths( void ) const;
+
+        //increase when sprite replace placeholder,dependent cache compare it to refresh
+        std::uint64_t get_generation( void ) const;
+        std::size_t get_decoded_count( void ) const;
+
+        //emit on main thread after decoded sprites uploaded
+        sigc::signal<void> signal_sprites_ready( void );
+
+        SpriteCache( const SpriteCache& rhs )=delete;
+        SpriteCache( SpriteCache&& rhs )=delete;
+        SpriteCache& operator=( const SpriteCache& rhs )=delete;
+        SpriteCache& operator=( SpriteCache&& rhs )=delete;
+    private:
+        struct DecodeJob
+        {
+            std::string image_path;
+            std::uint32_t pixel_size;
+            std::uint64_t epoch;
+        };
+
+        struct DecodeResult
+        {
+            std::string image_path;
+            std::uint64_t epoch;
+            //empty if decode success
+            std::string error_message;
+            std::uint32_t frame_count;
+            //premultiplied ARGB32,frame_count*pixel_size*pixel_size
+            std::vector<std::uint32_t> pixels;
+        };
+
+        void enqueue( const std::string& image_path , bool urgent );
+        void worker_loop( void );
+        void upload_results( void );
+        //replace displayed sprites by the rescaled sprites
+        void swap_pending( void );
+
+        std::string get_atlas_path( std::uint32_t device_size ) const;
+        //map atlas file of target size into pending sprites,sprite surface point to the mapped pixel
+        bool load_atlas( void );
+        void save_atlas( void );
+
+        //displayed sprites size
+        std::uint32_t pixel_size;
+        std::uint32_t scale;
+        //requested size,differ from displayed size while rescaling
+        std::uint32_t target_pixel_size;
+        std::uint32_t target_scale;
+        bool rescaling;
+        std::uint64_t generation;
+        //increase when pixel size change
+        std::uint64_t epoch;
+        Cairo::RefPtr<Cairo::ImageSurface> placeholder;
+        //exist image file,from ResourcesManager::get_images
+        std::set<std::string> image_paths;
+        //frame 0 keyed by image path,the other frames by frame_key
+        std::map<std::string,Cairo::RefPtr<Cairo::ImageSurface>> sprites;
+        //animated image only
+        std::map<std::string,std::uint32_t> frame_counts;
+        //target size sprites while rescaling
+        Cairo::RefPtr<Cairo::ImageSurface> pending_placeholder;
+        std::map<std::string,Cairo::RefPtr<Cairo::ImageSurface>> pending_sprites;
+        std::map<std::string,std::uint32_t> pending_frame_counts;
+        //displayed images not rescaled yet,swap when empty
+        std::set<std::string> pending_needed;
+        //submitted to worker of current epoch,main thread only
+        std::set<std::string> queued;
+        sigc::signal<void> sprites_ready;
+        //checksum of path,size and modify time of all images,atlas file is valid only if match
+        std::string source_hash;
+        //atlas of current pixel size loaded or written
+        bool atlas_ready;
+
+        //shared with worker,guard by job_mutex
+        std::mutex job_mutex;
+        std::condition_variable job_condition;
+        std::deque<DecodeJob> jobs;
+        std::vector<DecodeResult> results;
+        std::size_t in_flight;
+        bool stop;
+
+        Glib::Dispatcher dispatcher;
+        std::vector<std::thread> workers;
+    };
+}
+
+#endif
@@ -0,0 +1,179 @@
+#include <cmath>
+#include <cstdint>
+
+#include <algorithm>
+#include <string>
+
+#include <cairomm/cairomm.h>
+#include <pangomm.h>
+
+#include "text_cache.h"
+
+namespace MagicTower
+{
+    static const char digit_glyphs[] = "0123456789?";
+
+    static std::uint16_t color_bucket( double red , double green , double blue )
+    {
+        auto quantize = []( double value ) -> std::uint16_t
+        {
+            value = std::clamp( value , 0.0 , 1.0 );
+            return static_cast<std::uint16_t>( std::lround( value*15 ) );
+        };
+        return ( quantize( red ) << 8 ) | ( quantize( green ) << 4 ) | quantize( blue );
+    }
+
+    static double bucket_channel( std::uint16_t bucket , int shift )
+    {
+        return ( ( bucket >> shift ) & 0xF )/15.0;
+    }
+
+    TextCache::TextCache( std::size_t _capacity ):
+        capacity( _capacity ),
+        scale( 1 ),
+        measure_surface( Cairo::ImageSurface::create( Cairo::Format::FORMAT_ARGB32 , 1 , 1 ) ),
+        layout( Pango::Layout::create( Cairo::Context::create( measure_surface ) ) ),
+        lru_list(),
+        text_surfaces(),
+        digit_strips()
+    {
+    }
+
+    TextCache::TextSurface TextCache::get_text( const std::string& text , const Pango::FontDescription& font_desc ,
+        double red , double green , double blue )
+    {
+        std::uint16_t bucket = color_bucket( red , green , blue );
+        TextKey key = { text , font_desc.to_string() , bucket , this->scale };
+        auto iter = this->text_surfaces.find( key );
+        if ( iter != this->text_surfaces.end() )
+        {
+            //move to most recently used
+            this->lru_list.splice( this->lru_list.begin() , this->lru_list , iter->second.lru_iter );
+            return iter->second.text;
+        }
+
+        if ( ( this->capacity > 0 ) && ( this->text_surfaces.size() >= this->capacity ) )
+        {
+            this->text_surfaces.erase( this->lru_list.back() );
+            this->lru_list.pop_back();
+        }
+        TextSurface text_surface = this->rasterize( text , font_desc , bucket );
+        this->lru_list.push_front( key );
+        this->text_surfaces[key] = { text_surface , this->lru_list.begin() };
+        return text_surface;
+    }
+
+    int TextCache::draw_number( const Cairo::RefPtr<Cairo::Context>& cairo_context , double x , double y , std::int64_t number ,
+        const Pango::FontDescription& font_desc , double red , double green , double blue )
+    {
+        DigitStrip& strip = this->get_digit_strip( font_desc , color_bucket( red , green , blue ) );
+        std::string number_text;
+        if ( number >= 0 )
+            number_text = std::to_string( number );
+        else
+            number_text = std::string( "????" );
+
+        double draw_x = x;
+        cairo_context->save();
+        for ( char c : number_text )
+        {
+            std::size_t index = ( c == '?' ) ? 10 : static_cast<std::size_t>( c - '0' );
+            //blit the glyph cell from strip
+            cairo_context->set_source( strip.surface , draw_x - strip.offsets[index] , y );
+            cairo_context->rectangle( draw_x , y , strip.widths[index] , strip.height );
+            cairo_context->fill();
+            draw_x += strip.widths[index];
+        }
+        cairo_context->restore();
+
+        return static_cast<int>( draw_x - x );
+    }
+
+    void TextCache::set_context( const Glib::RefPtr<Pango::Context>& context )
+    {
+        this->layout = Pango::Layout::create( context );
+        this->clear();
+    }
+
+    void TextCache::set_scale( std::uint32_t _scale )
+    {
+        this->scale = std::max<std::uint32_t>( _scale , 1 );
+    }
+
+    void TextCache::clear()
+    {
+        this->lru_list.clear();
+        this->text_surfaces.clear();
+        this->digit_strips.clear();
+    }
+
+    Cairo::RefPtr<Cairo::ImageSurface> TextCache::create_surface( int width , int height )
+    {
+        int scale = static_cast<int>( this->scale );
+        auto surface = Cairo::ImageSurface::create( Cairo::Format::FORMAT_ARGB32 , std::max( width , 1 )*scale , std::max( height , 1 )*scale );
+        cairo_surface_set_device_scale( surface->cobj() , this->scale , this->scale );
+        return surface;
+    }
+
+    void TextCache::show_layout( const Cairo::RefPtr<Cairo::Context>& cairo_context , double x , double y )
+    {
+        cairo_context->move_to( x , y );
+        cairo_context->set_line_width( 0.5 );
+        this->layout->show_in_cairo_context( cairo_context );
+        cairo_context->fill_preserve();
+        cairo_context->stroke();
+    }
+
+    TextCache::TextSurface TextCache::rasterize( const std::string& text , const Pango::FontDescription& font_desc , std::uint16_t bucket )
+    {
+        this->layout->set_font_description( font_desc );
+        this->layout->set_text( text );
+        int layout_width = 0;
+        int layout_height = 0;
+        this->layout->get_pixel_size( layout_width , layout_height );
+
+        auto surface = this->create_surface( layout_width , layout_height );
+        auto cairo_context = Cairo::Context::create( surface );
+        cairo_context->set_source_rgb( bucket_channel( bucket , 8 ) , bucket_channel( bucket , 4 ) , bucket_channel( bucket , 0 ) );
+        this->show_layout( cairo_context , 0 , 0 );
+        return { surface , layout_width , layout_height };
+    }
+
+    TextCache::DigitStrip& TextCache::get_digit_strip( const Pango::FontDescription& font_desc , std::uint16_t bucket )
+    {
+        StripKey key = { font_desc.to_string() , bucket , this->scale };
+        auto iter = this->digit_strips.find( key );
+        if ( iter != this->digit_strips.end() )
+        {
+            return iter->second;
+        }
+
+        DigitStrip strip;
+        this->layout->set_font_description( font_desc );
+        int strip_width = 0;
+        int strip_height = 1;
+        for ( std::size_t i = 0 ; i < strip.widths.size() ; i++ )
+        {
+            this->layout->set_text( std::string( 1 , digit_glyphs[i] ) );
+            int glyph_width = 0;
+            int glyph_height = 0;
+            this->layout->get_pixel_size( glyph_width , glyph_height );
+            strip.offsets[i] = strip_width;
+            strip.widths[i] = glyph_width;
+            strip_width += glyph_width;
+            strip_height = std::max( strip_height , glyph_height );
+        }
+
+        strip.height = strip_height;
+        strip.surface = this->create_surface( strip_width , strip_height );
+        auto cairo_context = Cairo::Context::create( strip.surface );
+        cairo_context->set_source_rgb( bucket_channel( bucket , 8 ) , bucket_channel( bucket , 4 ) , bucket_channel( bucket , 0 ) );
+        for ( std::size_t i = 0 ; i < strip.widths.size() ; i++ )
+        {
+            this->layout->set_text( std::string( 1 , digit_glyphs[i] ) );
+            this->show_layout( cairo_context , strip.offsets[i] , 0 );
+        }
+
+        return this->digit_strips[key] = strip;
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+#ifndef TEXT_CACHE_H
+#define TEXT_CACHE_H
+
+#include <cstdint>
+
+#include <array>
+#include <list>
+#include <map>
+#include <string>
+#include <tuple>
+
+#include <cairomm/cairomm.h>
+#include <pangomm.h>
+
+namespace MagicTower
+{
+    //pre-rasterized text surface cache,key: ( text , font , color bucket , scale ),least recently used entry evicted first
+    class TextCache
+    {
+    public:
+        //surface has scale times pixel and device scale set,width,height:logical size
+        struct TextSurface
+        {
+            Cairo::RefPtr<Cairo::ImageSurface> surface;
+            int width;
+            int height;
+        };
+
+        TextCache( std::size_t capacity = 256 );
+
+        //color channel range [0,1],quantized to 16 levels per channel
+        TextSurface get_text( const std::string& text , const Pango::FontDescription& font_desc ,
+            double red , double green , double blue );
+
+        //draw number compose from per-digit glyph strip,no text shaping.
+        //negative number display as "????",return the drawn width
+        int draw_number( const Cairo::RefPtr<Cairo::Context>& cairo_context , double x , double y , std::int64_t number ,
+            const Pango::FontDescription& font_desc , double red , double green , double blue );
+
+        //layout of the widget context,font resolution and options follow the screen.clear the cache
+        void set_context( const Glib::RefPtr<Pango::Context>& context );
+
+        //rasterize at scale factor of the target surface,entries of other scale stay until evicted
+        void set_scale( std::uint32_t scale );
+
+        void clear();
+
+        TextCache( const TextCache& rhs )=delete;
+        TextCache( TextCache&& rhs )=delete;
+        TextCache& operator=( const TextCache& rhs )=delete;
+        TextCache& operator=( TextCache&& rhs )=delete;
+    private:
+        typedef std::tuple<std::string , std::string , std::uint16_t , std::uint32_t> TextKey;
+        typedef std::tuple<std::string , std::uint16_t , std::uint32_t> StripKey;
+
+        //glyph "0123456789?" rasterized in one line,offsets,widths and height are logical
+        struct DigitStrip
+        {
+            Cairo::RefPtr<Cairo::ImageSurface> surface;
+            std::array<int,11> offsets;
+            std::array<int,11> widths;
+            int height;
+        };
+
+        struct TextEntry
+        {
+            TextSurface text;
+            std::list<TextKey>::iterator lru_iter;
+        };
+
+        TextSurface rasterize( const std::string& text , const Pango::FontDescription& font_desc , std::uint16_t bucket );
+        //same as the uncached text of window,0.5 line width outline
+        void show_layout( const Cairo::RefPtr<Cairo::Context>& cairo_context , double x , double y );
+        DigitStrip& get_digit_strip( const Pango::FontDescription& font_desc , std::uint16_t bucket );
+        //logical size width*height,cairo can't create zero size surface
+        Cairo::RefPtr<Cairo::ImageSurface> create_surface( int width , int height );
+
+        std::size_t capacity;
+        std::uint32_t scale;
+        Cairo::RefPtr<Cairo::ImageSurface> measure_surface;
+        Glib::RefPtr<Pango::Layout> layout;
+        std::list<TextKey> lru_list;
+        std::map<TextKey , TextEntry> text_surfaces;
+        std::map<StripKey , DigitStrip> digit_strips;
+    };
+}
+
+#endif
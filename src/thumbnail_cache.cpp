@@ -0,0 +1,398 @@
+#include <cstdint>
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <cairomm/cairomm.h>
+#include <glibmm.h>
+
+#include "resources.h"
+#include "sprite_cache.h"
+#include "stairs.h"
+#include "thumbnail_cache.h"
+#include "tower.h"
+
+namespace MagicTower
+{
+    //downsampled sprite size,thumbnail grid sample it by nearest neighbor
+    static const std::uint32_t tile_size = 8;
+    //thumbnail longest side limit
+    static const std::uint32_t thumbnail_limit = 256;
+
+    //premultiplied ARGB32 source over destination
+    static std::uint32_t blend_over( std::uint32_t source , std::uint32_t destination )
+    {
+        std::uint32_t alpha = source >> 24;
+        if ( alpha == 0xFF )
+            return source;
+        if ( alpha == 0 )
+            return destination;
+        std::uint32_t result = 0;
+        for ( int shift = 0 ; shift < 32 ; shift += 8 )
+        {
+            std::uint32_t source_channel = ( source >> shift ) & 0xFF;
+            std::uint32_t destination_channel = ( destination >> shift ) & 0xFF;
+            std::uint32_t channel = source_channel + ( destination_channel*( 0xFF - alpha ) + 0x7F )/0xFF;
+            result |= std::min<std::uint32_t>( channel , 0xFF ) << shift;
+        }
+        return result;
+    }
+
+    ThumbnailCache::ThumbnailCache():
+        thumbnails(),
+        sprite_generation( 0 ),
+        tiled_images(),
+        tile_revision( 0 ),
+        stairs_types(),
+        serial( 0 ),
+        thumbnails_ready(),
+        tile_set(),
+        job_mutex(),
+        job_condition(),
+        sprites(),
+        jobs(),
+        results(),
+        stop( false ),
+        dispatcher(),
+        worker()
+    {
+        this->dispatcher.connect( sigc::mem_fun( *this , &ThumbnailCache::upload_results ) );
+        this->worker = std::thread( &ThumbnailCache::worker_loop , this );
+    }
+
+    ThumbnailCache::~ThumbnailCache()
+    {
+        {
+            std::lock_guard<std::mutex> lock( this->job_mutex );
+            this->stop = true;
+            this->sprites.clear();
+            this->jobs.clear();
+        }
+        this->job_condition.notify_all();
+        this->worker.join();
+    }
+
+    void ThumbnailCache::refresh( const TowerMap& tower , const std::vector<std::uint32_t>& floor_ids ,
+        const std::map<std::uint32_t,Stairs>& stairs , SpriteCache& sprite_cache )
+    {
+        if ( !this->stairs_types || this->sprite_generation != sprite_cache.get_generation() )
+        {
+            this->sprite_generation = sprite_cache.get_generation();
+            this->submit_sprites( stairs , sprite_cache );
+        }
+
+        std::vector<ThumbnailJob> new_jobs;
+        for ( std::uint32_t floor_id : floor_ids )
+        {
+            auto floor_iter = tower.map.find( floor_id );
+            if ( floor_iter == tower.map.end() )
+                continue;
+            const TowerFloor& floor = floor_iter->second;
+            Thumbnail& thumbnail = this->thumbnails[ floor_id ];
+            if ( ( thumbnail.serial != 0 ) && ( thumbnail.tile_revision == this->tile_revision ) &&
+                ( thumbnail.floor_generation == floor.generation ) )
+                continue;
+
+            thumbnail.floor_generation = floor.generation;
+            thumbnail.tile_revision = this->tile_revision;
+            thumbnail.serial = ++this->serial;
+            new_jobs.push_back( { floor_id , thumbnail.serial , floor.length , floor.width , floor.default_floorid , floor.content , this->stairs_types } );
+        }
+        if ( new_jobs.empty() )
+            return ;
+
+        {
+            std::lock_guard<std::mutex> lock( this->job_mutex );
+            for ( auto& job : new_jobs )
+            {
+                //the queued job of same floor is outdated
+                this->jobs.erase( std::remove_if( this->jobs.begin() , this->jobs.end() ,
+                    [ &job ]( const ThumbnailJob& queued ){ return queued.floor_id == job.floor_id; } ) , this->jobs.end() );
+                this->jobs.push_back( std::move( job ) );
+            }
+        }
+        this->job_condition.notify_one();
+    }
+
+    Cairo::RefPtr<Cairo::ImageSurface> ThumbnailCache::get_thumbnail( std::uint32_t floor_id ) const
+    {
+        auto iter = this->thumbnails.find( floor_id );
+        if ( iter == this->thumbnails.end() )
+            return {};
+        return iter->second.surface;
+    }
+
+    std::uint32_t ThumbnailCache::get_cell_size( std::uint32_t length , std::uint32_t width )
+    {
+        std::uint32_t longest = std::max<std::uint32_t>( { length , width , 1 } );
+        return std::clamp<std::uint32_t>( thumbnail_limit/longest , 1 , tile_size );
+    }
+
+    sigc::signal<void> ThumbnailCache::signal_thumbnails_ready( void )
+    {
+        return this->thumbnails_ready;
+    }
+
+    //the rescaled sprite of an image already tiled is skipped,its tile hardly differ
+    void ThumbnailCache::submit_sprites( const std::map<std::uint32_t,Stairs>& stairs , SpriteCache& sprite_cache )
+    {
+        auto new_stairs_types = std::make_shared<StairsTypes>();
+        for ( auto& stairs_pair : stairs )
+        {
+            ( *new_stairs_types )[ stairs_pair.first ] = stairs_pair.second.type;
+        }
+        this->stairs_types = new_stairs_types;
+
+        std::vector<SpriteSource> new_sprites;
+        for ( auto& image_path : sprite_cache.get_image_paths() )
+        {
+            if ( this->tiled_images.find( image_path ) != this->tiled_images.end() )
+                continue;
+            if ( !sprite_cache.is_decoded( image_path ) )
+            {
+                //tile it after decoded
+                sprite_cache.prefetch( image_path );
+                continue;
+            }
+            //cairo surface is not shared with worker,copy the pixel
+            auto surface = sprite_cache.get_sprite( image_path );
+            surface->flush();
+            const unsigned char * data = surface->get_data();
+            int stride = surface->get_stride();
+            SpriteSource source = { image_path , static_cast<std::uint32_t>( surface->get_width() ) ,
+                static_cast<std::uint32_t>( surface->get_height() ) , {} };
+            source.pixels.resize( static_cast<std::size_t>( source.width )*source.height );
+            for ( std::uint32_t y = 0 ; y < source.height ; y++ )
+            {
+                std::copy_n( reinterpret_cast<const std::uint32_t *>( data + y*stride ) , source.width ,
+                    source.pixels.data() + static_cast<std::size_t>( y )*source.width );
+            }
+            new_sprites.push_back( std::move( source ) );
+            this->tiled_images.insert( image_path );
+        }
+        if ( new_sprites.empty() )
+            return ;
+
+        this->tile_revision++;
+        {
+            std::lock_guard<std::mutex> lock( this->job_mutex );
+            std::move( new_sprites.begin() , new_sprites.end() , std::back_inserter( this->sprites ) );
+        }
+        this->job_condition.notify_one();
+    }
+
+    //box filter the sprite to tile_size*tile_size,run on worker thread
+    std::vector<std::uint32_t> ThumbnailCache::downsample( const SpriteSource& source )
+    {
+        std::uint32_t block = std::max<std::uint32_t>( std::min( source.width , source.height )/tile_size , 1 );
+        std::vector<std::uint32_t> tile( tile_size*tile_size , 0 );
+        for ( std::uint32_t tile_y = 0 ; tile_y < tile_size ; tile_y++ )
+        {
+            for ( std::uint32_t tile_x = 0 ; tile_x < tile_size ; tile_x++ )
+            {
+                std::uint32_t sums[4] = { 0 , 0 , 0 , 0 };
+                std::uint32_t count = 0;
+                for ( std::uint32_t y = tile_y*block ; y < ( tile_y + 1 )*block && y < source.height ; y++ )
+                {
+                    const std::uint32_t * row = source.pixels.data() + static_cast<std::size_t>( y )*source.width;
+                    for ( std::uint32_t x = tile_x*block ; x < ( tile_x + 1 )*block && x < source.width ; x++ )
+                    {
+                        for ( int channel = 0 ; channel < 4 ; channel++ )
+                            sums[channel] += ( row[x] >> ( channel*8 ) ) & 0xFF;
+                        count++;
+                    }
+                }
+                std::uint32_t pixel = 0;
+                for ( int channel = 0 ; channel < 4 && count > 0 ; channel++ )
+                    pixel |= ( sums[channel]/count ) << ( channel*8 );
+                tile[tile_y*tile_size + tile_x] = pixel;
+            }
+        }
+        return tile;
+    }
+
+    void ThumbnailCache::worker_loop( void )
+    {
+        while ( true )
+        {
+            std::vector<SpriteSource> new_sprites;
+            ThumbnailJob job;
+            {
+                std::unique_lock<std::mutex> lock( this->job_mutex );
+                this->job_condition.wait( lock , [ this ](){ return this->stop || !this->sprites.empty() || !this->jobs.empty(); } );
+                if ( this->stop )
+                    return ;
+                if ( !this->sprites.empty() )
+                {
+                    new_sprites.swap( this->sprites );
+                }
+                else
+                {
+                    job = std::move( this->jobs.front() );
+                    this->jobs.pop_front();
+                }
+            }
+
+            //the tiles are ready before the jobs submitted with them
+            if ( !new_sprites.empty() )
+            {
+                for ( auto& source : new_sprites )
+                {
+                    this->tile_set[ source.image_path ] = downsample( source );
+                }
+                continue;
+            }
+
+            ThumbnailResult result = compose( job , this->tile_set );
+            {
+                std::lock_guard<std::mutex> lock( this->job_mutex );
+                this->results.push_back( std::move( result ) );
+            }
+            this->dispatcher.emit();
+        }
+    }
+
+    //run on worker thread:plain pixel buffer only,no cairo and GTK
+    ThumbnailCache::ThumbnailResult ThumbnailCache::compose( const ThumbnailJob& job , const TileSet& tile_set )
+    {
+        std::uint32_t cell_size = get_cell_size( job.length , job.width );
+        ThumbnailResult result = { job.floor_id , job.serial , job.length*cell_size , job.width*cell_size , {} };
+        //outside grid display as backup image(black)
+        result.pixels.assign( static_cast<std::size_t>( result.pixel_width )*result.pixel_height , 0xFF000000 );
+
+        //( grid type , id ) -> tile,avoid building image path per grid
+        std::map<std::pair<GRID_TYPE,std::uint32_t>,const std::vector<std::uint32_t> *> tile_memo;
+        auto find_tile = [ &job , &tile_set , &tile_memo ]( GRID_TYPE type , std::uint32_t id ) -> const std::vector<std::uint32_t> *
+        {
+            auto memo_iter = tile_memo.find( { type , id } );
+            if ( memo_iter != tile_memo.end() )
+                return memo_iter->second;
+
+            std::string image_path;
+            switch ( type )
+            {
+                case GRID_TYPE::BOUNDARY:
+                    image_path = ResourcesManager::get_image( "boundary" , id );
+                    break;
+                case GRID_TYPE::FLOOR:
+                    image_path = ResourcesManager::get_image( "floor" , id );
+                    break;
+                case GRID_TYPE::WALL:
+                    image_path = ResourcesManager::get_image( "wall" , id );
+                    break;
+                case GRID_TYPE::STAIRS:
+                {
+                    auto stairs_iter = job.stairs_types->find( id );
+                    if ( stairs_iter != job.stairs_types->end() )
+                        image_path = ResourcesManager::get_image( "stairs" , stairs_iter->second );
+                    break;
+                }
+                case GRID_TYPE::DOOR:
+                    image_path = ResourcesManager::get_image( "door" , id );
+                    break;
+                case GRID_TYPE::NPC:
+                    image_path = ResourcesManager::get_image( "npc" , id );
+                    break;
+                case GRID_TYPE::MONSTER:
+                    image_path = ResourcesManager::get_image( "monster" , id );
+                    break;
+                case GRID_TYPE::ITEM:
+                    image_path = ResourcesManager::get_image( "item" , id );
+                    break;
+                default:
+                    break;
+            }
+            auto tile_iter = tile_set.find( image_path );
+            const std::vector<std::uint32_t> * tile = ( tile_iter != tile_set.end() ) ? &( tile_iter->second ) : nullptr;
+            tile_memo[ { type , id } ] = tile;
+            return tile;
+        };
+
+        auto draw_tile = [ &result , cell_size ]( std::uint32_t grid_x , std::uint32_t grid_y , const std::vector<std::uint32_t> * tile )
+        {
+            if ( tile == nullptr )
+                return ;
+            for ( std::uint32_t y = 0 ; y < cell_size ; y++ )
+            {
+                std::uint32_t * row = result.pixels.data() + static_cast<std::size_t>( grid_y*cell_size + y )*result.pixel_width + grid_x*cell_size;
+                const std::uint32_t * tile_row = tile->data() + ( y*tile_size/cell_size )*tile_size;
+                for ( std::uint32_t x = 0 ; x < cell_size ; x++ )
+                {
+                    row[x] = blend_over( tile_row[x*tile_size/cell_size] , row[x] );
+                }
+            }
+        };
+
+        std::size_t grid_count = std::min<std::size_t>( job.content.size() , static_cast<std::size_t>( job.length )*job.width );
+        for ( std::size_t i = 0 ; i < grid_count ; i++ )
+        {
+            const TowerGrid& grid = job.content[i];
+            std::uint32_t x = i%job.length;
+            std::uint32_t y = i/job.length;
+            switch ( grid.type )
+            {
+                case GRID_TYPE::BOUNDARY:
+                case GRID_TYPE::FLOOR:
+                case GRID_TYPE::WALL:
+                    draw_tile( x , y , find_tile( grid.type , grid.id ) );
+                    break;
+                case GRID_TYPE::STAIRS:
+                case GRID_TYPE::DOOR:
+                case GRID_TYPE::NPC:
+                case GRID_TYPE::MONSTER:
+                case GRID_TYPE::ITEM:
+                    //transparent grid:default floor underlay
+                    draw_tile( x , y , find_tile( GRID_TYPE::FLOOR , job.default_floorid ) );
+                    draw_tile( x , y , find_tile( grid.type , grid.id ) );
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        return result;
+    }
+
+    void ThumbnailCache::upload_results( void )
+    {
+        std::vector<ThumbnailResult> composed;
+        {
+            std::lock_guard<std::mutex> lock( this->job_mutex );
+            composed.swap( this->results );
+        }
+
+        bool uploaded = false;
+        for ( auto& result : composed )
+        {
+            auto iter = this->thumbnails.find( result.floor_id );
+            //floor changed again after submit,wait the newer result
+            if ( iter == this->thumbnails.end() || iter->second.serial != result.serial )
+                continue;
+            if ( result.pixel_width == 0 || result.pixel_height == 0 )
+                continue;
+
+            auto surface = Cairo::ImageSurface::create( Cairo::Format::FORMAT_ARGB32 , result.pixel_width , result.pixel_height );
+            surface->flush();
+            unsigned char * data = surface->get_data();
+            int stride = surface->get_stride();
+            for ( std::uint32_t y = 0 ; y < result.pixel_height ; y++ )
+            {
+                std::copy_n( result.pixels.data() + static_cast<std::size_t>( y )*result.pixel_width , result.pixel_width ,
+                    reinterpret_cast<std::uint32_t *>( data + y*stride ) );
+            }
+            surface->mark_dirty();
+            iter->second.surface = surface;
+            uploaded = true;
+        }
+
+        if ( uploaded )
+            this->thumbnails_ready.emit();
+    }
+}
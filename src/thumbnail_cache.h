@@ -0,0 +1,134 @@
+#pragma once
+#ifndef THUMBNAIL_CACHE_H
+#define THUMBNAIL_CACHE_H
+
+#include <cstdint>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cairomm/cairomm.h>
+#include <glibmm.h>
+#include <sigc++/sigc++.h>
+
+#include "sprite_cache.h"
+#include "stairs.h"
+#include "tower.h"
+
+namespace MagicTower
+{
+    //reduced scale floor image for minimap and floor browser.
+    //composed on a background thread from downsampled sprite tiles,a sprite is downsampled there once after decoded,
+    //sprite rescale don't change the tiles.
+    //only the floors whose generation changed or new tiles added since last submit are composed again
+    class ThumbnailCache
+    {
+    public:
+        ThumbnailCache();
+        ~ThumbnailCache();
+
+        //submit the floors which changed since last refresh,main thread only
+        void refresh( const TowerMap& tower , const std::vector<std::uint32_t>& floor_ids ,
+            const std::map<std::uint32_t,Stairs>& stairs , SpriteCache& sprite_cache );
+        //nullptr if the floor not composed yet
+        Cairo::RefPtr<Cairo::ImageSurface> get_thumbnail( std::uint32_t floor_id ) const;
+        //thumbnail pixel per grid,large floor get smaller grid
+        static std::uint32_t get_cell_size( std::uint32_t length , std::uint32_t width );
+
+        //emit on main thread after composed thumbnails uploaded
+        sigc::signal<void> signal_thumbnails_ready( void );
+
+        ThumbnailCache( const ThumbnailCache& rhs )=delete;
+        ThumbnailCache( ThumbnailCache&& rhs )=delete;
+        ThumbnailCache& operator=( const ThumbnailCache& rhs )=delete;
+        ThumbnailCache& operator=( ThumbnailCache&& rhs )=delete;
+    private:
+        //image path -> tile_size*tile_size premultiplied ARGB32
+        typedef std::map<std::string,std::vector<std::uint32_t>> TileSet;
+        //stairs id -> stairs image id
+        typedef std::map<std::uint32_t,std::uint32_t> StairsTypes;
+
+        //pixel copy of a decoded sprite,downsampled on worker
+        struct SpriteSource
+        {
+            std::string image_path;
+            std::uint32_t width;
+            std::uint32_t height;
+            //premultiplied ARGB32
+            std::vector<std::uint32_t> pixels;
+        };
+
+        struct ThumbnailJob
+        {
+            std::uint32_t floor_id;
+            std::uint64_t serial;
+            std::uint32_t length;
+            std::uint32_t width;
+            std::uint32_t default_floorid;
+            std::vector<TowerGrid> content;
+            std::shared_ptr<const StairsTypes> stairs_types;
+        };
+
+        struct ThumbnailResult
+        {
+            std::uint32_t floor_id;
+            std::uint64_t serial;
+            std::uint32_t pixel_width;
+            std::uint32_t pixel_height;
+            std::vector<std::uint32_t> pixels;
+        };
+
+        struct Thumbnail
+        {
+            Cairo::RefPtr<Cairo::ImageSurface> surface;
+            //floor generation of last submit
+            std::uint64_t floor_generation;
+            std::uint64_t tile_revision;
+            //serial of last submit,older result is discarded
+            std::uint64_t serial;
+        };
+
+        //copy the newly decoded sprites for worker
+        void submit_sprites( const std::map<std::uint32_t,Stairs>& stairs , SpriteCache& sprite_cache );
+        void worker_loop( void );
+        void upload_results( void );
+        static std::vector<std::uint32_t> downsample( const SpriteSource& source );
+        static ThumbnailResult compose( const ThumbnailJob& job , const TileSet& tile_set );
+
+        //main thread only
+        std::map<std::uint32_t,Thumbnail> thumbnails;
+        //sprite generation of last submit_sprites
+        std::uint64_t sprite_generation;
+        //images submitted to worker
+        std::set<std::string> tiled_images;
+        //increase when tiles added
+        std::uint64_t tile_revision;
+        std::shared_ptr<const StairsTypes> stairs_types;
+        std::uint64_t serial;
+        sigc::signal<void> thumbnails_ready;
+
+        //worker only
+        TileSet tile_set;
+
+        //shared with worker,guard by job_mutex
+        std::mutex job_mutex;
+        std::condition_variable job_condition;
+        //downsampled before the queued jobs
+        std::vector<SpriteSource> sprites;
+        std::deque<ThumbnailJob> jobs;
+        std::vector<ThumbnailResult> results;
+        bool stop;
+
+        Glib::Dispatcher dispatcher;
+        std::thread worker;
+    };
+}
+
+#endif
@@ -0,0 +1,70 @@
+#include <cstdint>
+
+#include <string>
+
+#include <cairomm/cairomm.h>
+
+#include "resources.h"
+#include "sprite_cache.h"
+#include "tile_cache.h"
+
+namespace MagicTower
+{
+    TileCache::TileCache( std::size_t _capacity ):
+        capacity( _capacity ),
+        sprite_generation( 0 ),
+        lru_list(),
+        tiles()
+    {
+    }
+
+    Cairo::RefPtr<Cairo::ImageSurface> TileCache::get_tile( SpriteCache& sprite_cache , std::uint32_t floor_id ,
+        const std::string& entity_type , std::uint32_t entity_id , std::uint64_t frame )
+    {
+        if ( this->sprite_generation != sprite_cache.get_generation() )
+        {
+            this->clear();
+            this->sprite_generation = sprite_cache.get_generation();
+        }
+
+        std::string entity_path = ResourcesManager::get_image( entity_type , entity_id );
+        std::uint32_t entity_frame = frame%sprite_cache.get_frame_count( entity_path );
+        TileKey key = { floor_id , entity_type , entity_id , entity_frame };
+        auto iter = this->tiles.find( key );
+        if ( iter != this->tiles.end() )
+        {
+            //move to most recently used
+            this->lru_list.splice( this->lru_list.begin() , this->lru_list , iter->second.lru_iter );
+            return iter->second.surface;
+        }
+
+        if ( ( this->capacity > 0 ) && ( this->tiles.size() >= this->capacity ) )
+        {
+            this->tiles.erase( this->lru_list.back() );
+            this->lru_list.pop_back();
+        }
+        auto floor_sprite = sprite_cache.get_sprite( ResourcesManager::get_image( "floor" , floor_id ) );
+        auto entity_sprite = sprite_cache.get_sprite( entity_path , entity_frame );
+        auto surface = Cairo::ImageSurface::create( Cairo::Format::FORMAT_ARGB32 , floor_sprite->get_width() , floor_sprite->get_height() );
+        //same device scale as sprite,paint pixel to pixel on HiDPI
+        double x_scale = 1 , y_scale = 1;
+        cairo_surface_get_device_scale( floor_sprite->cobj() , &x_scale , &y_scale );
+        cairo_surface_set_device_scale( surface->cobj() , x_scale , y_scale );
+        auto cairo_context = Cairo::Context::create( surface );
+        cairo_context->set_source( floor_sprite , 0 , 0 );
+        cairo_context->paint();
+        cairo_context->set_source( entity_sprite , 0 , 0 );
+        cairo_context->paint();
+        surface->flush();
+
+        this->lru_list.push_front( key );
+        this->tiles[key] = { surface , this->lru_list.begin() };
+        return surface;
+    }
+
+    void TileCache::clear()
+    {
+        this->lru_list.clear();
+        this->tiles.clear();
+    }
+}
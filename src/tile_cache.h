@@ -0,0 +1,53 @@
+#pragma once
+#ifndef TILE_CACHE_H
+#define TILE_CACHE_H
+
+#include <cstdint>
+
+#include <list>
+#include <map>
+#include <string>
+#include <tuple>
+
+#include <cairomm/cairomm.h>
+
+#include "sprite_cache.h"
+
+namespace MagicTower
+{
+    //transparent entity sprite merged over its floor underlay,one blit per grid.
+    //key:( floor id , entity image type , entity image id , animation frame ),built on first use,
+    //least recently used entry evicted first,all entries dropped when sprites change
+    class TileCache
+    {
+    public:
+        TileCache( std::size_t capacity = 256 );
+
+        //frame:animation frame of entity,wrap around its frame count
+        Cairo::RefPtr<Cairo::ImageSurface> get_tile( SpriteCache& sprite_cache , std::uint32_t floor_id ,
+            const std::string& entity_type , std::uint32_t entity_id , std::uint64_t frame = 0 );
+
+        void clear();
+
+        TileCache( const TileCache& rhs )=delete;
+        TileCache( TileCache&& rhs )=delete;
+        TileCache& operator=( const TileCache& rhs )=delete;
+        TileCache& operator=( TileCache&& rhs )=delete;
+    private:
+        typedef std::tuple<std::uint32_t , std::string , std::uint32_t , std::uint32_t> TileKey;
+
+        struct TileEntry
+        {
+            Cairo::RefPtr<Cairo::ImageSurface> surface;
+            std::list<TileKey>::iterator lru_iter;
+        };
+
+        std::size_t capacity;
+        //sprite cache generation of the entries,placeholder and pixel size change bump it
+        std::uint64_t sprite_generation;
+        std::list<TileKey> lru_list;
+        std::map<TileKey , TileEntry> tiles;
+    };
+}
+
+#endif
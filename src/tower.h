@@ -2,8 +2,10 @@
 #ifndef TOWER_H
 #define TOWER_H
 
+#include <cstddef>
 #include <cstdint>
 
+#include <algorithm>
 #include <string>
 
 #include <vector>
@@ -34,12 +36,39 @@ namespace MagicTower
         std::uint32_t id;
     };
 
+    inline bool operator==( const TowerGrid& lhs , const TowerGrid& rhs )
+    {
+        return ( lhs.type == rhs.type ) && ( lhs.id == rhs.id );
+    }
+
+    inline bool operator!=( const TowerGrid& lhs , const TowerGrid& rhs )
+    {
+        return !( lhs == rhs );
+    }
+
+    enum class VISION_SHAPE:std::uint32_t
+    {
+        //|dx| <= field_vision.x and |dy| <= field_vision.y
+        BOX = 0,
+        //ellipse with semi axis field_vision.x,field_vision.y
+        CIRCLE,
+        //CIRCLE and blocked by wall,boundary and door
+        SIGHT
+    };
+
     struct TowerGridLocation
     {
         //path search algorith call std::abs( x1 - x2 ).
         std::int64_t x, y;
     };
 
+    //process wide unique,every floor content state get its own value,main thread only
+    inline std::uint64_t next_floor_generation( void )
+    {
+        static std::uint64_t generation = 0;
+        return ++generation;
+    }
+
     /* CREATE TABLE towerfloor (
         id                  INTEGER  PRIMARY KEY AUTOINCREMENT,
         length              INT (32),
@@ -50,7 +79,8 @@ namespace MagicTower
         fv_x                INT (32),
         fv_y                INT (32),
         name                TEXT,
-        content             BLOB
+        content             BLOB,
+        fv_shape            INT (32)
     );
      */
     struct TowerFloor
@@ -63,11 +93,28 @@ namespace MagicTower
         std::optional<TowerGridLocation> teleport_point;
         std::optional<TowerGridLocation> field_vision;
         std::vector<TowerGrid> content;
+        //only used when field_vision has value
+        VISION_SHAPE vision_shape = VISION_SHAPE::BOX;
+        //new value on construction and every set_grid,copy keep it.
+        //equal generation means equal floor,save and thumbnail skip the unchanged floor by it
+        std::uint64_t generation = next_floor_generation();
+    };
+
+    //one set_grid,enough to undo and redo it
+    struct GridChange
+    {
+        std::uint32_t floor_id;
+        std::uint32_t x;
+        std::uint32_t y;
+        TowerGrid before;
+        TowerGrid after;
     };
 
     struct TowerMap
     {
         std::map<std::uint32_t,TowerFloor> map;
+        //set_grid append here while not nullptr,only ActionJournal set it on the game map
+        std::vector<GridChange> * grid_journal = nullptr;
 
         TowerGrid get_grid( std::uint32_t floor_id , std::uint32_t x , std::uint32_t y )
         {
@@ -95,9 +142,98 @@ namespace MagicTower
             {
                 return ;
             }
+            if ( this->grid_journal != nullptr )
+                this->grid_journal->push_back( { floor_id , x , y , floor.content[y*floor.length+x] , grid } );
             floor.content[y*floor.length+x] = grid;
+            floor.generation = next_floor_generation();
         }
     };
+
+    //floor id -> immutable floor,shared between snapshot owners
+    typedef std::map<std::uint32_t , std::shared_ptr<const TowerFloor>> TowerSnapshot;
+
+    //one grid differ from the baseline tower
+    struct GridDelta
+    {
+        std::uint32_t floor_id;
+        //y*length + x
+        std::uint32_t index;
+        TowerGrid grid;
+    };
+
+    //sorted by ( floor_id , index )
+    typedef std::vector<GridDelta> TowerDelta;
+
+    //floor id -> TowerFloor::generation,equal map means equal tower
+    typedef std::map<std::uint32_t , std::uint64_t> TowerGenerations;
+
+    inline TowerGenerations get_generations( const TowerSnapshot& tower )
+    {
+        TowerGenerations generations;
+        for ( auto& [ floor_id , floor ] : tower )
+        {
+            generations[ floor_id ] = floor->generation;
+        }
+        return generations;
+    }
+
+    //append the grids of floor differ from base floor,size mismatch grids are not representable and skipped
+    inline void diff_floor( std::uint32_t floor_id , const TowerFloor& base_floor , const TowerFloor& floor , TowerDelta& delta )
+    {
+        //same generation,same content
+        if ( base_floor.generation == floor.generation )
+            return ;
+        std::size_t grid_count = std::min( base_floor.content.size() , floor.content.size() );
+        for ( std::size_t i = 0 ; i < grid_count ; i++ )
+        {
+            if ( floor.content[i] != base_floor.content[i] )
+                delta.push_back( { floor_id , static_cast<std::uint32_t>( i ) , floor.content[i] } );
+        }
+    }
+
+    //false if a delta out of the tower,the grids before it are applied
+    inline bool apply_tower_delta( TowerMap& tower , const TowerDelta& delta )
+    {
+        for ( const GridDelta& grid_delta : delta )
+        {
+            auto floor_iter = tower.map.find( grid_delta.floor_id );
+            if ( floor_iter == tower.map.end() || floor_iter->second.length == 0 )
+                return false;
+            TowerFloor& floor = floor_iter->second;
+            if ( grid_delta.index >= floor.content.size() )
+                return false;
+            tower.set_grid( grid_delta.floor_id , grid_delta.index%floor.length , grid_delta.index/floor.length , grid_delta.grid );
+        }
+        return true;
+    }
+
+    //FNV-1a of floor shape and grids,a save delta only apply to the baseline of same hash
+    inline std::uint64_t hash_tower( const TowerSnapshot& tower )
+    {
+        std::uint64_t hash = 14695981039346656037ull;
+        //little endian bytes,no struct padding or host byte order in the hash
+        auto mix = [ &hash ]( std::uint32_t value )
+        {
+            for ( int i = 0 ; i < 4 ; i++ )
+            {
+                hash ^= ( value >> ( 8*i ) ) & 0xFF;
+                hash *= 1099511628211ull;
+            }
+        };
+        for ( auto& [ floor_id , floor ] : tower )
+        {
+            mix( floor_id );
+            mix( floor->length );
+            mix( floor->width );
+            mix( floor->default_floorid );
+            for ( const TowerGrid& grid : floor->content )
+            {
+                mix( static_cast<std::uint32_t>( grid.type ) );
+                mix( grid.id );
+            }
+        }
+        return hash;
+    }
 }
 
 #endif
@@ -0,0 +1,232 @@
+#include <cstdint>
+#include <cstdlib>
+
+#include <algorithm>
+#include <vector>
+
+#include "tower.h"
+#include "vision.h"
+
+namespace MagicTower
+{
+    VisionMask::VisionMask():
+        valid( false ),
+        floor_id( 0 ),
+        origin_x( 0 ),
+        origin_y( 0 ),
+        length( 0 ),
+        width( 0 ),
+        all_visible( true ),
+        vision( { 0 , 0 } ),
+        shape( VISION_SHAPE::BOX ),
+        box_x( 0 ),
+        box_y( 0 ),
+        box_length( 0 ),
+        box_width( 0 ),
+        content(),
+        mask()
+    {
+    }
+
+    bool VisionMask::update( const TowerMap& tower , std::uint32_t _floor_id , std::uint32_t x , std::uint32_t y )
+    {
+        auto floor_iter = tower.map.find( _floor_id );
+        if ( floor_iter == tower.map.end() )
+        {
+            this->valid = true;
+            this->floor_id = _floor_id;
+            this->length = 0;
+            this->width = 0;
+            this->all_visible = false;
+            this->content.clear();
+            this->mask.clear();
+            return true;
+        }
+        const TowerFloor& floor = floor_iter->second;
+
+        if ( this->valid && ( this->floor_id == _floor_id ) && ( this->length == floor.length ) && ( this->width == floor.width ) )
+        {
+            if ( !floor.field_vision.has_value() && this->all_visible )
+                return false;
+            if ( floor.field_vision.has_value() && !this->all_visible && ( this->origin_x == x ) && ( this->origin_y == y ) &&
+                ( this->vision.x == floor.field_vision.value().x ) && ( this->vision.y == floor.field_vision.value().y ) &&
+                ( this->shape == floor.vision_shape ) &&
+                ( this->shape != VISION_SHAPE::SIGHT || this->content == this->box_content( floor ) ) )
+                return false;
+        }
+
+        this->valid = true;
+        this->floor_id = _floor_id;
+        this->origin_x = x;
+        this->origin_y = y;
+        this->length = floor.length;
+        this->width = floor.width;
+        this->all_visible = !floor.field_vision.has_value();
+        this->content.clear();
+        this->mask.clear();
+        if ( this->all_visible )
+            return true;
+
+        this->vision = floor.field_vision.value();
+        this->shape = floor.vision_shape;
+        this->box_x = std::max<std::int64_t>( 0 , this->origin_x - this->vision.x );
+        this->box_y = std::max<std::int64_t>( 0 , this->origin_y - this->vision.y );
+        this->box_length = std::max<std::int64_t>( 0 , std::min<std::int64_t>( this->length , this->origin_x + this->vision.x + 1 ) - this->box_x );
+        this->box_width = std::max<std::int64_t>( 0 , std::min<std::int64_t>( this->width , this->origin_y + this->vision.y + 1 ) - this->box_y );
+        this->mask.assign( this->box_length*this->box_width , 0 );
+        switch ( this->shape )
+        {
+            case VISION_SHAPE::BOX:
+            case VISION_SHAPE::CIRCLE:
+            {
+                for ( std::int64_t map_y = this->box_y ; map_y < this->box_y + this->box_width ; map_y++ )
+                {
+                    for ( std::int64_t map_x = this->box_x ; map_x < this->box_x + this->box_length ; map_x++ )
+                    {
+                        if ( this->in_range( map_x - this->origin_x , map_y - this->origin_y ) )
+                            this->set_visible( map_x , map_y );
+                    }
+                }
+                break;
+            }
+            case VISION_SHAPE::SIGHT:
+            {
+                //octant transform:( xx , xy , yx , yy )
+                static const std::int64_t octants[8][4] =
+                {
+                    {  1 ,  0 ,  0 ,  1 } , {  0 ,  1 ,  1 ,  0 } , {  0 , -1 ,  1 ,  0 } , { -1 ,  0 ,  0 ,  1 } ,
+                    { -1 ,  0 ,  0 , -1 } , {  0 , -1 , -1 ,  0 } , {  0 ,  1 , -1 ,  0 } , {  1 ,  0 ,  0 , -1 }
+                };
+                this->content = this->box_content( floor );
+                this->set_visible( this->origin_x , this->origin_y );
+                for ( auto& octant : octants )
+                {
+                    this->cast_light( 1 , 1.0 , 0.0 , octant[0] , octant[1] , octant[2] , octant[3] );
+                }
+                break;
+            }
+        }
+
+        return true;
+    }
+
+    bool VisionMask::is_visible( std::int64_t x , std::int64_t y ) const
+    {
+        if ( ( x < 0 ) || ( y < 0 ) || ( x >= this->length ) || ( y >= this->width ) )
+            return false;
+        if ( this->all_visible )
+            return true;
+        if ( !this->in_box( x , y ) )
+            return false;
+        return this->mask[( y - this->box_y )*this->box_length + ( x - this->box_x )] != 0;
+    }
+
+    bool VisionMask::in_range( std::int64_t dx , std::int64_t dy ) const
+    {
+        if ( ( std::abs( dx ) > this->vision.x ) || ( std::abs( dy ) > this->vision.y ) )
+            return false;
+        if ( this->shape == VISION_SHAPE::BOX )
+            return true;
+        //( dx/vx )^2 + ( dy/vy )^2 <= 1,without division
+        std::int64_t vx2 = this->vision.x*this->vision.x;
+        std::int64_t vy2 = this->vision.y*this->vision.y;
+        return dx*dx*vy2 + dy*dy*vx2 <= vx2*vy2;
+    }
+
+    bool VisionMask::in_box( std::int64_t x , std::int64_t y ) const
+    {
+        return ( x >= this->box_x ) && ( y >= this->box_y ) && ( x < this->box_x + this->box_length ) && ( y < this->box_y + this->box_width );
+    }
+
+    std::vector<TowerGrid> VisionMask::box_content( const TowerFloor& floor ) const
+    {
+        std::vector<TowerGrid> grids;
+        grids.reserve( this->box_length*this->box_width );
+        for ( std::int64_t map_y = this->box_y ; map_y < this->box_y + this->box_width ; map_y++ )
+        {
+            for ( std::int64_t map_x = this->box_x ; map_x < this->box_x + this->box_length ; map_x++ )
+            {
+                std::size_t index = map_y*floor.length + map_x;
+                if ( index < floor.content.size() )
+                    grids.push_back( floor.content[index] );
+                else
+                    grids.push_back( { GRID_TYPE::UNKNOWN , 0 } );
+            }
+        }
+        return grids;
+    }
+
+    bool VisionMask::is_opaque( std::int64_t x , std::int64_t y ) const
+    {
+        //vision never reach outside the bounding box,treat as opaque
+        if ( !this->in_box( x , y ) )
+            return true;
+        switch ( this->content[( y - this->box_y )*this->box_length + ( x - this->box_x )].type )
+        {
+            case GRID_TYPE::BOUNDARY:
+            case GRID_TYPE::WALL:
+            case GRID_TYPE::DOOR:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    void VisionMask::set_visible( std::int64_t x , std::int64_t y )
+    {
+        if ( !this->in_box( x , y ) )
+            return ;
+        this->mask[( y - this->box_y )*this->box_length + ( x - this->box_x )] = 1;
+    }
+
+    void VisionMask::cast_light( std::int64_t row , double start_slope , double end_slope ,
+        std::int64_t xx , std::int64_t xy , std::int64_t yx , std::int64_t yy )
+    {
+        if ( start_slope < end_slope )
+            return ;
+        std::int64_t radius = std::max( this->vision.x , this->vision.y );
+        double next_start_slope = start_slope;
+        for ( std::int64_t distance = row ; distance <= radius ; distance++ )
+        {
+            bool blocked = false;
+            std::int64_t delta_y = -distance;
+            for ( std::int64_t delta_x = -distance ; delta_x <= 0 ; delta_x++ )
+            {
+                double left_slope = ( delta_x - 0.5 )/( delta_y + 0.5 );
+                double right_slope = ( delta_x + 0.5 )/( delta_y - 0.5 );
+                if ( start_slope < right_slope )
+                    continue;
+                if ( end_slope > left_slope )
+                    break;
+
+                std::int64_t dx = delta_x*xx + delta_y*xy;
+                std::int64_t dy = delta_x*yx + delta_y*yy;
+                std::int64_t map_x = this->origin_x + dx;
+                std::int64_t map_y = this->origin_y + dy;
+                //the wall itself is visible
+                if ( this->in_range( dx , dy ) )
+                    this->set_visible( map_x , map_y );
+
+                bool opaque = this->is_opaque( map_x , map_y );
+                if ( blocked )
+                {
+                    if ( opaque )
+                    {
+                        next_start_slope = right_slope;
+                        continue;
+                    }
+                    blocked = false;
+                    start_slope = next_start_slope;
+                }
+                else if ( opaque && distance < radius )
+                {
+                    blocked = true;
+                    this->cast_light( distance + 1 , start_slope , left_slope , xx , xy , yx , yy );
+                    next_start_slope = right_slope;
+                }
+            }
+            if ( blocked )
+                break;
+        }
+    }
+}
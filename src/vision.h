@@ -0,0 +1,57 @@
+#pragma once
+#ifndef VISION_H
+#define VISION_H
+
+#include <cstdint>
+
+#include <vector>
+
+#include "tower.h"
+
+namespace MagicTower
+{
+    //visible grid of the hero floor,map coordinate.
+    //computed once per move from TowerFloor::field_vision,shared by draw and path finding
+    class VisionMask
+    {
+    public:
+        VisionMask();
+
+        //recompute if floor,hero position,vision setting or(SIGHT shape only) floor content changed,
+        //return true if recomputed
+        bool update( const TowerMap& tower , std::uint32_t floor_id , std::uint32_t x , std::uint32_t y );
+        //outside the floor is invisible
+        bool is_visible( std::int64_t x , std::int64_t y ) const;
+    private:
+        bool in_range( std::int64_t dx , std::int64_t dy ) const;
+        bool in_box( std::int64_t x , std::int64_t y ) const;
+        //copy the floor content in bounding box
+        std::vector<TowerGrid> box_content( const TowerFloor& floor ) const;
+        bool is_opaque( std::int64_t x , std::int64_t y ) const;
+        void set_visible( std::int64_t x , std::int64_t y );
+        //recursive shadowcasting of one octant,( xx , xy , yx , yy ) transform octant coordinate to map coordinate
+        void cast_light( std::int64_t row , double start_slope , double end_slope ,
+            std::int64_t xx , std::int64_t xy , std::int64_t yx , std::int64_t yy );
+
+        bool valid;
+        std::uint32_t floor_id;
+        std::uint32_t origin_x;
+        std::uint32_t origin_y;
+        std::uint32_t length;
+        std::uint32_t width;
+        //field_vision is std::nullopt:all visible
+        bool all_visible;
+        TowerGridLocation vision;
+        VISION_SHAPE shape;
+        //mask and content only cover the vision bounding box( clamp to floor ),cost not grow with floor size
+        std::int64_t box_x;
+        std::int64_t box_y;
+        std::int64_t box_length;
+        std::int64_t box_width;
+        //floor content in bounding box,used by SIGHT shape
+        std::vector<TowerGrid> content;
+        std::vector<std::uint8_t> mask;
+    };
+}
+
+#endif
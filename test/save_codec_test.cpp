@@ -0,0 +1,114 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../src/tower.h"
+#include "../src/save_codec.h"
+
+using namespace MagicTower;
+
+static int failures = 0;
+
+static void check( bool condition , const std::string& what )
+{
+    if ( !condition )
+    {
+        std::fprintf( stderr , "FAIL:%s\n" , what.c_str() );
+        failures++;
+    }
+}
+
+static bool same_delta( const TowerDelta& lhs , const TowerDelta& rhs )
+{
+    if ( lhs.size() != rhs.size() )
+        return false;
+    for ( std::size_t i = 0 ; i < lhs.size() ; i++ )
+    {
+        if ( lhs[i].floor_id != rhs[i].floor_id || lhs[i].index != rhs[i].index || lhs[i].grid != rhs[i].grid )
+            return false;
+    }
+    return true;
+}
+
+static bool decode_throws( const std::vector<std::uint8_t>& blob )
+{
+    try
+    {
+        decode_tower_delta( blob.data() , blob.size() );
+    }
+    catch ( const std::runtime_error& )
+    {
+        return true;
+    }
+    return false;
+}
+
+static void test_round_trip( const std::string& name , const TowerDelta& delta )
+{
+    std::vector<std::uint8_t> blob = encode_tower_delta( delta );
+    TowerDelta decoded;
+    try
+    {
+        decoded = decode_tower_delta( blob.data() , blob.size() );
+    }
+    catch ( const std::runtime_error& e )
+    {
+        check( false , name + " round trip throw:" + e.what() );
+        return ;
+    }
+    check( same_delta( delta , decoded ) , name + " round trip" );
+
+    //every proper prefix is broken
+    for ( std::size_t size = 0 ; size < blob.size() ; size++ )
+    {
+        std::vector<std::uint8_t> truncated( blob.begin() , blob.begin() + size );
+        check( decode_throws( truncated ) , name + " truncated to " + std::to_string( size ) );
+    }
+    //any flipped bit is caught by magic,version or checksum
+    for ( std::size_t i = 0 ; i < blob.size() ; i++ )
+    {
+        std::vector<std::uint8_t> corrupted = blob;
+        corrupted[i] ^= 0x01;
+        check( decode_throws( corrupted ) , name + " corrupted at " + std::to_string( i ) );
+    }
+    std::vector<std::uint8_t> extended = blob;
+    extended.push_back( 0 );
+    check( decode_throws( extended ) , name + " trailing byte" );
+}
+
+int main( void )
+{
+    const std::uint32_t max_uint32 = std::numeric_limits<std::uint32_t>::max();
+
+    test_round_trip( "empty" , {} );
+    test_round_trip( "single" , { { 1 , 0 , { GRID_TYPE::FLOOR , 1 } } } );
+    test_round_trip( "floors" , {
+        { 0 , 3 , { GRID_TYPE::WALL , 2 } },
+        { 0 , 4 , { GRID_TYPE::MONSTER , 17 } },
+        { 0 , 120 , { GRID_TYPE::ITEM , 300 } },
+        { 2 , 1 , { GRID_TYPE::DOOR , 1 } },
+        { 2 , 2 , { GRID_TYPE::UNKNOWN , 0 } },
+        { 9 , 0 , { GRID_TYPE::STAIRS , 4 } }
+    });
+    test_round_trip( "limits" , {
+        { 0 , max_uint32 , { GRID_TYPE::NPC , max_uint32 } },
+        { max_uint32 , 0 , { GRID_TYPE::BOUNDARY , 0 } },
+        { max_uint32 , max_uint32 , { GRID_TYPE::UNKNOWN , max_uint32 } }
+    });
+
+    std::vector<std::uint8_t> foreign = { 'S' , 'Q' , 'L' , 1 , 0 , 0 , 0 , 0 , 0 };
+    check( decode_throws( foreign ) , "foreign magic" );
+
+    if ( failures != 0 )
+    {
+        std::fprintf( stderr , "%d check failed\n" , failures );
+        return 1;
+    }
+    std::printf( "save codec:all check passed\n" );
+    return 0;
+}